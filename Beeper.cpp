@@ -0,0 +1,94 @@
+#include "Beeper.h"
+
+//Gate ramp, one millisecond from silence to full level
+static const float RAMP_STEP = 1000.0f / AUDIO_SAMPLE_RATE;
+
+//Correction for a unit step at t = 0 of a phase in [0, 1) advancing by dt
+//per sample, spread over the sample either side of the step
+static double poly_blep(double t, double dt)
+{
+    if(t < dt) {
+        t /= dt;
+        return t + t - t * t - 1.0;
+    }
+    if(t > 1.0 - dt) {
+        t = (t - 1.0) / dt;
+        return t * t + t + t + 1.0;
+    }
+    return 0.0;
+}
+
+BeeperSynth::BeeperSynth(float frequency, float volume)
+    : increment(static_cast<double>(frequency) / AUDIO_SAMPLE_RATE),
+      volume(volume)
+{
+}
+
+void BeeperSynth::Render(BeeperEdge const* edges, std::size_t edgeCount, uint64_t cycle,
+                         float* out, std::size_t count)
+{
+    uint64_t span = cycle > last_cycle ? cycle - last_cycle : 0;
+    std::size_t next = 0;
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        //Edges take effect at the sample their cycle maps to
+        while(next < edgeCount)
+        {
+            uint64_t at = edges[next].cycle > last_cycle ? edges[next].cycle - last_cycle : 0;
+            if(span > 0 && at * count / span > i) {
+                break;
+            }
+
+            //A tone starting from silence always starts at the same phase
+            gate = edges[next].on;
+            if(gate && level == 0.0f) {
+                phase = 0.0;
+            }
+            next++;
+        }
+
+        if(gate) {
+            level = level + RAMP_STEP < 1.0f ? level + RAMP_STEP : 1.0f;
+        }
+        else {
+            level = level > RAMP_STEP ? level - RAMP_STEP : 0.0f;
+        }
+
+        float sample = 0.0f;
+        if(level > 0.0f)
+        {
+            double square = phase < 0.5 ? 1.0 : -1.0;
+            square += poly_blep(phase, increment);
+
+            double half = phase + 0.5;
+            square -= poly_blep(half < 1.0 ? half : half - 1.0, increment);
+
+            sample = static_cast<float>(square) * level * volume;
+        }
+        out[i] = sample;
+
+        phase += increment;
+        if(phase >= 1.0) {
+            phase -= 1.0;
+        }
+    }
+
+    //Edges past the end of the span still decide where the next one starts
+    while(next < edgeCount) {
+        gate = edges[next++].on;
+    }
+    last_cycle = cycle;
+}
+
+void BeeperSynth::Render(Chip8& chip8, float* out, std::size_t count)
+{
+    Render(chip8.GetBeeperEdges(), chip8.GetBeeperEdgeCount(), chip8.GetCycleCount(), out, count);
+    chip8.ClearBeeperEdges();
+}
+
+void BeeperSynth::Reset(uint64_t cycle, bool on)
+{
+    last_cycle = cycle;
+    gate = on;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "Chip8.h"
+#include <cstddef>
+#include <cstdint>
+
+const unsigned int AUDIO_SAMPLE_RATE = 48000;
+const unsigned int SAMPLES_PER_FRAME = AUDIO_SAMPLE_RATE / TIMER_RATE;
+
+//Turns the beeper edges Chip8 logs into mono float samples. The tone is a
+//square wave with PolyBLEP-corrected transitions, so it stays free of
+//aliasing at any pitch, and the gate ramps over a millisecond instead of
+//clicking. Never allocates.
+class BeeperSynth {
+    public:
+        explicit BeeperSynth(float frequency = 440.0f, float volume = 0.25f);
+
+        //Fills count samples spanning the emulated time from the previous
+        //call up to cycle, switching the gate at each edge's position
+        void Render(BeeperEdge const* edges, std::size_t edgeCount, uint64_t cycle,
+                    float* out, std::size_t count);
+
+        //Renders the edges chip8 logged since the last call and clears them
+        void Render(Chip8& chip8, float* out, std::size_t count);
+
+        //Continues from another point in emulated time, as after a rollback
+        void Reset(uint64_t cycle, bool on);
+
+    private:
+        double increment;
+        float volume;
+
+        double phase {};
+        float level {};
+        bool gate {};
+        uint64_t last_cycle {};
+};
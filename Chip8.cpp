@@ -1,10 +1,15 @@
 #pragma once
 #include "Chip8.h"
-#include <fstream>
+#include "Compiled.h"
+#include "Jit.h"
+#include "Sprite.h"
+#include "Profiler.h"
 #include <iostream>
 #include <cstdint>
+#include <cstring>
 #include <chrono>
-#include <random> 
+#include <algorithm>
+#include <iterator>
 
 /*
 Keypad       Keyboard
@@ -19,8 +24,7 @@ Keypad       Keyboard
 +-+-+-+-+    +-+-+-+-+
 */
 
-uint8_t memory[4096] {};
-uint8_t font_sprites[16 * 5] = 
+const uint8_t font_sprites[16 * 5] = 
 {
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
     0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -40,20 +44,66 @@ uint8_t font_sprites[16 * 5] =
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-const unsigned int START_ADD = 0x200;
-const unsigned int FONTSET_START_ADDRESS = 0x50;
+uint64_t Chip8::HashBytes(uint8_t const* data, std::size_t size)
+{
+    //FNV-1a
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for(std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+//splitmix64's finalizer; a change anywhere in key reaches every bit
+static uint64_t mix(uint64_t key)
+{
+    key = (key ^ (key >> 30u)) * 0xBF58476D1CE4E5B9ull;
+    key = (key ^ (key >> 27u)) * 0x94D049BB133111EBull;
+    return key ^ (key >> 31u);
+}
+
+//Zero bytes and blank rows contribute nothing, so a machine starts out
+//with an empty screen hash
+uint64_t Chip8::memory_term(uint16_t address, uint8_t value)
+{
+    return value != 0 ? mix(static_cast<uint64_t>(address) << 8u | value) : 0;
+}
+
+uint64_t Chip8::row_term(unsigned int row, uint64_t bits)
+{
+    return bits != 0 ? mix(mix(bits) ^ (static_cast<uint64_t>(MEMORY_SIZE + row) << 8u)) : 0;
+}
+
+void Chip8::rehash_memory()
+{
+    memory_hash = 0;
+    for(unsigned int address = 0; address < MEMORY_SIZE; address++) {
+        memory_hash ^= memory_term(static_cast<uint16_t>(address), memory[address]);
+    }
+}
 
-Chip8::Chip8() 
-    : randGen(std::chrono::system_clock::now().time_since_epoch().count())
+Chip8::Chip8(uint64_t seed) 
+    : image(std::make_shared<MemoryImage>()),
+      memory(image->bytes)
 {
+    Seed(seed);
+
     program_counter = START_ADD;
 
     for(int i=0; i<80; i++) 
     {
         memory[FONTSET_START_ADDRESS + i] = font_sprites[i];
     }
+    rehash_memory();
 
-    randByte = std::uniform_int_distribution<uint8_t>(0, 255U);
+    rom_image = image;
+    rom_hash = HashBytes(nullptr, 0);
+
+    std::fill(std::begin(table), std::end(table), &Chip8::OP_NULL);
+    std::fill(std::begin(table0), std::end(table0), &Chip8::OP_NULL);
+    std::fill(std::begin(table8), std::end(table8), &Chip8::OP_NULL);
+    std::fill(std::begin(tableE), std::end(tableE), &Chip8::OP_NULL);
+    std::fill(std::begin(tableF), std::end(tableF), &Chip8::OP_NULL);
 
     table[0x0] = &Chip8::Table0;
     table[0x1] = &Chip8::OP_1nnn;
@@ -66,9 +116,7 @@ Chip8::Chip8()
     table[0x8] = &Chip8::Table8;
     table[0x9] = &Chip8::OP_9xy0;
     table[0xA] = &Chip8::OP_Annn;
-    table[0xB] = &Chip8::OP_Bnnn;
     table[0xC] = &Chip8::OP_Cxkk;
-    table[0xD] = &Chip8::OP_Dxyn;
     table[0xE] = &Chip8::TableE;
     table[0xF] = &Chip8::TableF;
 
@@ -76,14 +124,9 @@ Chip8::Chip8()
     table0[0xE] = &Chip8::OP_00EE;
 
     table8[0x0] = &Chip8::OP_8xy0;
-    table8[0x1] = &Chip8::OP_8xy1;
-    table8[0x2] = &Chip8::OP_8xy2;
-    table8[0x3] = &Chip8::OP_8xy3;
     table8[0x4] = &Chip8::OP_8xy4;
     table8[0x5] = &Chip8::OP_8xy5;
-    table8[0x6] = &Chip8::OP_8xy6;
     table8[0x7] = &Chip8::OP_8xy7;
-    table8[0xE] = &Chip8::OP_8xyE;
 
     tableE[0x1] = &Chip8::OP_ExA1;
     tableE[0xE] = &Chip8::OP_Ex9E;
@@ -95,40 +138,238 @@ Chip8::Chip8()
     tableF[0x1E] = &Chip8::OP_Fx1E;
     tableF[0x29] = &Chip8::OP_Fx29;
     tableF[0x33] = &Chip8::OP_Fx33;
-    tableF[0x55] = &Chip8::OP_Fx55;
-    tableF[0x65] = &Chip8::OP_Fx65;
+
+    //Bnnn, Dxyn, 8xy1/2/3/6/E, Fx55 and Fx65 depend on the quirk profile
+    select_quirks();
 }
 
-void Chip8::Table0()
+template<typename Quirks>
+void Chip8::install_quirks()
 {
-    ((*this).*(table0[opcode & 0x000Fu]))();
+    table[0xB] = &Chip8::OP_Bnnn<Quirks>;
+    table[0xD] = &Chip8::OP_Dxyn<Quirks>;
+
+    table8[0x1] = &Chip8::OP_8xy1<Quirks>;
+    table8[0x2] = &Chip8::OP_8xy2<Quirks>;
+    table8[0x3] = &Chip8::OP_8xy3<Quirks>;
+    table8[0x6] = &Chip8::OP_8xy6<Quirks>;
+    table8[0xE] = &Chip8::OP_8xyE<Quirks>;
+
+    tableF[0x55] = &Chip8::OP_Fx55<Quirks>;
+    tableF[0x65] = &Chip8::OP_Fx65<Quirks>;
 }
 
-void Chip8::Table8()
+void Chip8::select_quirks()
 {
-    ((*this).*(table8[opcode & 0x000Fu]))();
+    switch(quirks)
+    {
+        case QuirkProfile::CosmacVip:
+            wrap_sprites ? install_quirks<WrappingQuirks<CosmacVipQuirks>>() : install_quirks<CosmacVipQuirks>();
+            break;
+        case QuirkProfile::Chip48:
+            wrap_sprites ? install_quirks<WrappingQuirks<Chip48Quirks>>() : install_quirks<Chip48Quirks>();
+            break;
+        case QuirkProfile::SuperChip:
+            wrap_sprites ? install_quirks<WrappingQuirks<SuperChipQuirks>>() : install_quirks<SuperChipQuirks>();
+            break;
+    }
+
+    //Decoded slots and blocks hold the old handlers
+    invalidate_decoded();
+
+    compiled = CompiledRomRegistry::Global().Find(rom_hash, quirks, wrap_sprites);
+    check_compiled();
 }
 
-void Chip8::TableE()
+void Chip8::check_compiled()
 {
-    ((*this).*(tableE[opcode & 0x000Fu]))();
+    compiled_stale = false;
+    if(!compiled) {
+        return;
+    }
+
+    for(unsigned int address = 0; address < MEMORY_SIZE; address++)
+    {
+        if(compiled->code_map[address] && memory[address] != compiled->image[address]) {
+            compiled_stale = true;
+            return;
+        }
+    }
 }
 
-void Chip8::TableF()
+void Chip8::Seed(uint64_t seed)
 {
-    ((*this).*(tableF[opcode & 0x00FFu]))();
+    //splitmix64 spreads nearby seeds apart and avoids the all-zero state
+    uint64_t mixed = seed + 0x9E3779B97F4A7C15ull;
+    mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ull;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBull;
+    mixed ^= mixed >> 31;
+
+    rng_state = mixed != 0 ? mixed : 0x9E3779B97F4A7C15ull;
 }
 
-void Chip8::OP_NULL()
-{}
+uint8_t Chip8::random_byte()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
 
-void Chip8::Cycle()
+    //The high bits of xorshift64 are the best mixed
+    return static_cast<uint8_t>(rng_state >> 56);
+}
+
+Chip8::TranslationCache& Chip8::TranslationCache::operator=(TranslationCache const&)
 {
-    fetch();
+    decoded.clear();
+    blocks.clear();
+    block_code.clear();
+    block_index.clear();
+    code_map.clear();
+    code_dirty = false;
+    jit.reset();
+    jit_code.clear();
+    jit_dirty = false;
+    return *this;
+}
 
-    //using first nibble to identify sub-table function
-    ((*this).*table[(opcode & 0xF000u) >> 12u])(); 
+void Chip8::Table0(Instruction const& op)
+{
+    ((*this).*(table0[op.n]))(op);
+}
+
+void Chip8::Table8(Instruction const& op)
+{
+    ((*this).*(table8[op.n]))(op);
+}
+
+void Chip8::TableE(Instruction const& op)
+{
+    ((*this).*(tableE[op.n]))(op);
+}
+
+void Chip8::TableF(Instruction const& op)
+{
+    ((*this).*(tableF[op.kk]))(op);
+}
+
+void Chip8::OP_NULL(Instruction const& op)
+{
+    if(!invalid_seen)
+    {
+        invalid_seen = true;
+        invalid_address = (program_counter - 2) & ADDRESS_MASK;
+        invalid_opcode = op.opcode;
+    }
+}
+
+void Chip8::OP_Decode(Instruction const&)
+{
+    //program_counter has already moved past the instruction being decoded
+    uint16_t address = (program_counter - 2) & ADDRESS_MASK;
+    uint16_t opcode = (memory[address] << 8u) + memory[(address + 1) & ADDRESS_MASK];
+
+    Instruction& slot = cache.decoded[address];
+    slot = decode(opcode);
+    slot.handler = resolve(opcode);
+
+    ((*this).*slot.handler)(slot);
+}
+
+Chip8::Instruction Chip8::decode(uint16_t opcode) const
+{
+    Instruction op {};
+    op.handler = table[(opcode & 0xF000u) >> 12u];
+    op.opcode = opcode;
+    op.nnn = opcode & 0x0FFFu;
+    op.x = (opcode & 0x0F00u) >> 8u;
+    op.y = (opcode & 0x00F0u) >> 4u;
+    op.kk = opcode & 0x00FFu;
+    op.n = opcode & 0x000Fu;
+    return op;
+}
+
+Chip8::Chip8Func Chip8::resolve(uint16_t opcode) const
+{
+    //Follows the sub-tables ahead of time so the cache holds leaf handlers
+    switch((opcode & 0xF000u) >> 12u)
+    {
+        case 0x0: return table0[opcode & 0x000Fu];
+        case 0x8: return table8[opcode & 0x000Fu];
+        case 0xE: return tableE[opcode & 0x000Fu];
+        case 0xF: return tableF[opcode & 0x00FFu];
+        default: return table[(opcode & 0xF000u) >> 12u];
+    }
+}
+
+void Chip8::own_memory()
+{
+    if(image.use_count() > 1)
+    {
+        image = std::make_shared<MemoryImage>(*image);
+        memory = image->bytes;
+    }
+}
+
+void Chip8::write_memory(uint16_t address, uint8_t value)
+{
+    address &= ADDRESS_MASK;
+    own_memory();
+    memory_hash ^= memory_term(address, memory[address]) ^ memory_term(address, value);
+    memory[address] = value;
+
+    //A byte belongs to the instruction starting at it and the one before it
+    if(!cache.decoded.empty())
+    {
+        cache.decoded[address].handler = &Chip8::OP_Decode;
+        cache.decoded[(address - 1) & ADDRESS_MASK].handler = &Chip8::OP_Decode;
+    }
 
+    if(compiled && compiled->code_map[address] && value != compiled->image[address]) {
+        compiled_stale = true;
+    }
+
+    //Stores always end a block, so the flush can wait until the block exits
+    if(!cache.code_map.empty() && cache.code_map[address])
+    {
+        cache.code_dirty = true;
+    }
+
+    if(!cache.jit_code.empty() && cache.jit_code[address]) {
+        cache.jit_dirty = true;
+    }
+}
+
+void Chip8::invalidate_decoded()
+{
+    for(Instruction& slot : cache.decoded)
+    {
+        slot.handler = &Chip8::OP_Decode;
+    }
+
+    cache.code_dirty = true;
+    cache.jit_dirty = true;
+}
+
+void Chip8::allocate_decoded()
+{
+    if(cache.decoded.empty())
+    {
+        cache.decoded.resize(MEMORY_SIZE);
+        invalidate_decoded();
+    }
+}
+
+void Chip8::allocate_blocks()
+{
+    if(cache.block_index.empty())
+    {
+        cache.block_index.assign(MEMORY_SIZE, 0);
+        cache.code_map.assign(MEMORY_SIZE, 0);
+    }
+}
+
+void Chip8::tick_timers(uint64_t cycle)
+{
     //decrement delay timer if set
     if(delay_timer > 0) {
         delay_timer--;
@@ -137,12 +378,636 @@ void Chip8::Cycle()
     //decrement sound timer if set 
     if(sound_timer > 0) {
         sound_timer--;
+
+        if(sound_timer == 0 && beeper_on) {
+            log_beeper_edge(cycle, false);
+        }
+    }
+}
+
+void Chip8::advance_clock(uint64_t cycles)
+{
+    uint64_t start = cycle_count;
+    cycle_count += cycles;
+
+    //The n-th tick falls on the first cycle whose phase reaches n * clock_rate
+    uint64_t phase = timer_phase + cycles * TIMER_RATE;
+    uint64_t boundary = clock_rate;
+    while(phase >= clock_rate)
+    {
+        phase -= clock_rate;
+        tick_timers(start + (boundary - timer_phase + TIMER_RATE - 1) / TIMER_RATE);
+        boundary += clock_rate;
+    }
+    timer_phase = static_cast<uint32_t>(phase);
+}
+
+void Chip8::log_beeper_edge(uint64_t cycle, bool on)
+{
+    beeper_on = on;
+
+    //Edges alternate, so when full, dropping the last one instead of adding
+    //this one leaves the log ending in the same state
+    if(beeper_edge_count == MAX_BEEPER_EDGES) {
+        beeper_edge_count--;
+        return;
+    }
+    beeper_edges[beeper_edge_count++] = BeeperEdge {cycle, on};
+}
+
+void Chip8::finish_yield()
+{
+    yield_requested = false;
+
+    bool on = sound_timer > 0;
+    if(on != beeper_on) {
+        log_beeper_edge(cycle_count, on);
+    }
+}
+
+void Chip8::reset_beeper()
+{
+    beeper_on = sound_timer > 0;
+    beeper_edge_count = 0;
+    yield_requested = false;
+}
+
+void Chip8::SetKeys(uint16_t keys)
+{
+    uint16_t pressed = keys & ~keypad;
+    keypad = keys;
+
+    if(key_wait && pressed != 0)
+    {
+        //The lowest newly pressed key completes Fx0A
+        uint8_t key = 0;
+        while(!(pressed & (1u << key))) {
+            key++;
+        }
+
+        registers[key_wait_register] = key;
+        key_wait = false;
+        key_wait_register = 0;
+        program_counter += 2;
+    }
+}
+
+void Chip8::SetQuirks(QuirkProfile profile)
+{
+    quirks = profile;
+    select_quirks();
+}
+
+void Chip8::SetSpriteWrap(bool wrap)
+{
+    wrap_sprites = wrap;
+    select_quirks();
+}
+
+uint64_t Chip8::CyclesUntilTimerTick() const
+{
+    return (clock_rate - timer_phase + TIMER_RATE - 1) / TIMER_RATE;
+}
+
+void Chip8::SetClockRate(uint32_t hz)
+{
+    clock_rate = hz > 0 ? hz : 1;
+    timer_phase = 0;
+}
+
+void Chip8::Cycle()
+{
+    fetch();
+
+    //using first nibble to identify sub-table function
+    ((*this).*current.handler)(current);
+
+    advance_clock(1);
+    if(yield_requested) {
+        finish_yield();
+    }
+}
+
+template<typename Profiler>
+void Chip8::Cycle(Profiler& profiler)
+{
+    uint16_t address = program_counter & ADDRESS_MASK;
+    fetch();
+
+    profiler.OnInstruction(address, current.opcode);
+
+    //ENABLED is a constant, so NullProfiler builds reduce to Cycle()
+    if(Profiler::ENABLED && current.handler == table[0xD]) {
+        auto start = std::chrono::steady_clock::now();
+        ((*this).*current.handler)(current);
+        profiler.OnDraw(std::chrono::steady_clock::now() - start);
+    }
+    else {
+        ((*this).*current.handler)(current);
+    }
+
+    if(Profiler::ENABLED && key_wait) {
+        profiler.OnKeyWait();
+    }
+
+    advance_clock(1);
+    if(yield_requested) {
+        finish_yield();
+    }
+}
+
+template void Chip8::Cycle(NullProfiler&);
+template void Chip8::Cycle(InstructionProfiler&);
+
+void Chip8::CycleCached()
+{
+    allocate_decoded();
+
+    Instruction const& op = cache.decoded[program_counter & ADDRESS_MASK];
+    increment_pc();
+
+    ((*this).*op.handler)(op);
+
+    advance_clock(1);
+    if(yield_requested) {
+        finish_yield();
+    }
+}
+
+void Chip8::SetEngine(Engine selected)
+{
+    engine = selected;
+}
+
+void Chip8::RunFor(uint64_t cycles)
+{
+    //Timers only change between segments, so each engine can run a
+    //segment without checking the clock per instruction
+    while(cycles > 0)
+    {
+        //Nothing runs until SetKeys ends the wait, so only time passes
+        if(key_wait) {
+            advance_clock(cycles);
+            break;
+        }
+
+        uint64_t segment = CyclesUntilTimerTick();
+        if(segment > cycles) {
+            segment = cycles;
+        }
+
+        //Idle loops are looked for at the tick and after a 1nnn yields on
+        //one, so engines otherwise keep whole segments
+        uint64_t lead;
+        uint64_t idle = skip_idle_loop(segment, lead);
+        if(idle > 0)
+        {
+            advance_clock(idle);
+            cycles -= idle;
+            skipped_cycles += idle;
+            continue;
+        }
+
+        //Stop at the loop's top so the next pass can skip from there
+        if(lead > 0 && lead < segment) {
+            segment = lead;
+        }
+
+        //A yield ends the segment early so an edge gets its exact cycle
+        uint64_t ran = execute(segment);
+        advance_clock(ran);
+        cycles -= ran;
+
+        if(yield_requested) {
+            finish_yield();
+        }
+    }
+}
+
+uint64_t Chip8::skip_idle_loop(uint64_t segment, uint64_t& lead)
+{
+    lead = 0;
+    if(!idle_skip) {
+        return 0;
+    }
+
+    //Nothing but the pc is involved, and it does not change
+    if(opcode_at(program_counter) == (0x1000u | program_counter)) {
+        return segment;
+    }
+
+    //The delay timer poll; a tick can leave the pc on any of its three
+    //instructions
+    for(uint16_t offset = 0; offset < 6; offset += 2)
+    {
+        uint16_t top = program_counter - offset;
+        if(!polls_delay_timer(top)) {
+            continue;
+        }
+
+        if(offset > 0)
+        {
+            lead = 3 - offset / 2;
+            return 0;
+        }
+
+        //Until the tick every iteration reads the same timer value, so
+        //either all of them jump back or the first one leaves
+        uint16_t test = opcode_at(top + 2);
+        unsigned int x = (test >> 8u) & 0xFu;
+        uint8_t kk = test & 0xFFu;
+        bool stays = (test >> 12u) == 0x3 ? delay_timer != kk : delay_timer == kk;
+        if(!stays) {
+            return 0;
+        }
+
+        uint64_t skipped = segment - segment % 3;
+        if(skipped > 0) {
+            registers[x] = delay_timer;
+        }
+        return skipped;
+    }
+
+    return 0;
+}
+
+uint16_t Chip8::opcode_at(uint16_t address) const
+{
+    return static_cast<uint16_t>(memory[address & ADDRESS_MASK] << 8u | memory[(address + 1) & ADDRESS_MASK]);
+}
+
+bool Chip8::polls_delay_timer(uint16_t top) const
+{
+    uint16_t load = opcode_at(top);
+    uint16_t test = opcode_at(top + 2);
+    unsigned int x = (load >> 8u) & 0xFu;
+
+    return (load & 0xF0FFu) == 0xF007u && opcode_at(top + 4) == (0x1000u | top)
+           && ((test >> 12u) == 0x3 || (test >> 12u) == 0x4) && ((test >> 8u) & 0xFu) == x;
+}
+
+bool Chip8::jumps_into_idle_loop(uint16_t address, uint16_t target) const
+{
+    return target == address || (target + 4 == address && polls_delay_timer(target));
+}
+
+uint64_t Chip8::RunUntilFrame()
+{
+    uint64_t cycles = CyclesUntilTimerTick();
+    RunFor(cycles);
+    return cycles;
+}
+
+template<typename Profiler>
+void Chip8::RunFor(uint64_t cycles, Profiler& profiler)
+{
+    for(uint64_t i = 0; i < cycles; i++) {
+        Cycle(profiler);
+    }
+}
+
+template<typename Profiler>
+uint64_t Chip8::RunUntilFrame(Profiler& profiler)
+{
+    uint64_t cycles = CyclesUntilTimerTick();
+    RunFor(cycles, profiler);
+    return cycles;
+}
+
+template void Chip8::RunFor(uint64_t, NullProfiler&);
+template void Chip8::RunFor(uint64_t, InstructionProfiler&);
+template uint64_t Chip8::RunUntilFrame(NullProfiler&);
+template uint64_t Chip8::RunUntilFrame(InstructionProfiler&);
+
+uint64_t Chip8::execute(uint64_t count)
+{
+    //Each loop stops right after an instruction that yields
+    uint64_t i = 0;
+
+    switch(engine)
+    {
+        case Engine::Table:
+            while(i < count && !yield_requested) {
+                fetch();
+                ((*this).*current.handler)(current);
+                i++;
+            }
+            return i;
+
+        case Engine::Cached:
+            allocate_decoded();
+            while(i < count && !yield_requested) {
+                Instruction const& op = cache.decoded[program_counter & ADDRESS_MASK];
+                increment_pc();
+                ((*this).*op.handler)(op);
+                i++;
+            }
+            return i;
+
+        case Engine::Threaded:
+            return run_blocks(count);
+
+        case Engine::Compiled:
+            return run_compiled(count);
+
+        case Engine::Jit:
+            return run_jit(count);
+    }
+    return i;
+}
+
+bool Chip8::ends_block(Chip8Func handler) const
+{
+    //Anything that can move the pc somewhere other than the next
+    //instruction, plus the stores that may rewrite translated code
+    return handler == &Chip8::OP_00EE
+        || handler == &Chip8::OP_1nnn
+        || handler == &Chip8::OP_2nnn
+        || handler == &Chip8::OP_3xkk
+        || handler == &Chip8::OP_4xkk
+        || handler == &Chip8::OP_5xy0
+        || handler == &Chip8::OP_9xy0
+        || handler == table[0xB]
+        || handler == &Chip8::OP_Ex9E
+        || handler == &Chip8::OP_ExA1
+        || handler == &Chip8::OP_Fx0A
+        || handler == &Chip8::OP_Fx18
+        || handler == &Chip8::OP_Fx33
+        || handler == tableF[0x55];
+}
+
+uint32_t Chip8::translate_block(uint16_t start)
+{
+    const uint16_t MAX_BLOCK_LENGTH = 64;
+
+    Block block {};
+    block.start = start;
+    block.first = static_cast<uint32_t>(cache.block_code.size());
+
+    uint16_t address = start;
+    for(;;)
+    {
+        uint16_t opcode = (memory[address] << 8u) + memory[(address + 1) & ADDRESS_MASK];
+
+        Instruction op = decode(opcode);
+        op.handler = resolve(opcode);
+        cache.block_code.push_back(op);
+        block.length++;
+
+        cache.code_map[address] = 1;
+        cache.code_map[(address + 1) & ADDRESS_MASK] = 1;
+        address = (address + 2) & ADDRESS_MASK;
+
+        if(ends_block(op.handler) || block.length == MAX_BLOCK_LENGTH || address < start)
+        {
+            break;
+        }
+    }
+
+    cache.blocks.push_back(block);
+    cache.block_index[start] = static_cast<uint32_t>(cache.blocks.size());
+    return static_cast<uint32_t>(cache.blocks.size());
+}
+
+void Chip8::flush_blocks()
+{
+    cache.blocks.clear();
+    cache.block_code.clear();
+    std::fill(cache.block_index.begin(), cache.block_index.end(), 0);
+    std::fill(cache.code_map.begin(), cache.code_map.end(), 0);
+    cache.code_dirty = false;
+}
+
+uint64_t Chip8::run_blocks(uint64_t count)
+{
+    uint32_t current_block = 0;
+    uint64_t remaining = count;
+
+    allocate_blocks();
+
+    //Yielding instructions end their block, so this stops right after one
+    while(remaining > 0 && !yield_requested)
+    {
+        if(cache.code_dirty)
+        {
+            flush_blocks();
+            current_block = 0;
+        }
+
+        uint16_t start = program_counter & ADDRESS_MASK;
+
+        //Follow the chained edge when the previous block predicted this pc
+        uint32_t number = 0;
+        if(current_block != 0 && cache.blocks[current_block - 1].chain_pc == start)
+        {
+            number = cache.blocks[current_block - 1].chain_block;
+        }
+        if(number == 0)
+        {
+            number = cache.block_index[start];
+            if(number == 0)
+            {
+                number = translate_block(start);
+            }
+            if(current_block != 0)
+            {
+                cache.blocks[current_block - 1].chain_pc = start;
+                cache.blocks[current_block - 1].chain_block = number;
+            }
+        }
+
+        Block const& block = cache.blocks[number - 1];
+        uint64_t length = block.length < remaining ? block.length : remaining;
+        Instruction const* op = &cache.block_code[block.first];
+
+        for(uint64_t i = 0; i < length; i++, op++)
+        {
+            increment_pc();
+            ((*this).*op->handler)(*op);
+        }
+
+        remaining -= length;
+        current_block = number;
+    }
+
+    return count - remaining;
+}
+
+uint64_t Chip8::run_compiled(uint64_t count)
+{
+    uint64_t i = 0;
+
+    while(i < count && !yield_requested)
+    {
+        //Translated code hands back anything it cannot run, which then goes
+        //through the reference path one instruction at a time
+        uint64_t ran = compiled && !compiled_stale ? compiled->run(*this, count - i) : 0;
+        if(ran == 0) {
+            fetch();
+            ((*this).*current.handler)(current);
+            ran = 1;
+        }
+        i += ran;
+    }
+
+    return i;
+}
+
+uint64_t Chip8::run_jit(uint64_t count)
+{
+    if(!cache.jit)
+    {
+        cache.jit.reset(new JitCode(*this));
+        cache.jit_code.assign(MEMORY_SIZE, 0);
+    }
+
+    uint64_t i = 0;
+
+    while(i < count && !yield_requested)
+    {
+        if(cache.jit_dirty) {
+            cache.jit->Flush(*this);
+        }
+
+        uint64_t ran = cache.jit->Run(*this, count - i);
+        if(ran > 0)
+        {
+            i += ran;
+            continue;
+        }
+
+        //Cold code, and whatever the JIT leaves out, runs on the reference
+        //path up to the end of its block
+        do {
+            fetch();
+            ((*this).*current.handler)(current);
+            i++;
+        } while(i < count && !yield_requested && !ends_block(resolve(current.opcode)));
+    }
+
+    return i;
+}
+
+uint32_t Chip8::PresentScreen(uint32_t* rgba)
+{
+    uint32_t rows = dirty_rows;
+
+    ExpandScreen(screen, rows, rgba);
+
+    dirty_rows = 0;
+    return rows;
+}
+
+void Chip8::ExpandScreen(uint64_t const* rows, uint32_t rowMask, uint32_t* rgba)
+{
+    for(unsigned int row = 0; row < VIDEO_HEIGHT; row++)
+    {
+        if(!(rowMask & (1u << row))) {
+            continue;
+        }
+
+        uint64_t bits = rows[row];
+        uint32_t* out = rgba + row * VIDEO_WIDTH;
+
+        for(unsigned int col = 0; col < VIDEO_WIDTH; col++) {
+            //Sign-extending the top bit yields 0xFFFFFFFF for lit pixels
+            out[col] = static_cast<uint32_t>(static_cast<int64_t>(bits << col) >> 63);
+        }
+    }
+}
+
+uint64_t Chip8::GetScreenHash() const
+{
+    return HashScreen(screen);
+}
+
+uint64_t Chip8::HashScreen(uint64_t const* rows)
+{
+    uint8_t packed[VIDEO_WIDTH / 8 * VIDEO_HEIGHT];
+    uint8_t* out = packed;
+
+    for(unsigned int row = 0; row < VIDEO_HEIGHT; row++) {
+        for(int shift = 56; shift >= 0; shift -= 8) {
+            *out++ = static_cast<uint8_t>(rows[row] >> shift);
+        }
     }
+
+    return HashBytes(packed, sizeof(packed));
+}
+
+bool Chip8::GetInvalidOpcode(uint16_t& address, uint16_t& opcode) const
+{
+    address = invalid_address;
+    opcode = invalid_opcode;
+    return invalid_seen;
+}
+
+uint64_t Chip8::GetStateHash() const
+{
+    uint8_t packed[72];
+    uint8_t* out = packed;
+    auto put = [&out](uint64_t value, unsigned int bytes) {
+        for(unsigned int i = 0; i < bytes; i++) {
+            *out++ = static_cast<uint8_t>(value >> (8u * i));
+        }
+    };
+
+    for(uint8_t value : registers) {
+        put(value, 1);
+    }
+    for(uint16_t entry : stack) {
+        put(entry, 2);
+    }
+    put(program_counter, 2);
+    put(index_register, 2);
+    put(stack_pointer, 1);
+    put(delay_timer, 1);
+    put(sound_timer, 1);
+    put(keypad, 2);
+    put(key_wait, 1);
+    //Like StateEquals, the register only counts during a wait
+    put(key_wait ? key_wait_register : 0, 1);
+    put(static_cast<uint8_t>(fault), 1);
+    put(timer_phase, 4);
+    put(rng_state, 8);
+
+    //Draws are too frequent to pay for hashing; rows are brought up to date
+    //here instead, and only those changed since the last call
+    for(unsigned int row = 0; row < VIDEO_HEIGHT; row++)
+    {
+        if(screen[row] != hashed_rows[row])
+        {
+            screen_hash ^= row_term(row, hashed_rows[row]) ^ row_term(row, screen[row]);
+            hashed_rows[row] = screen[row];
+        }
+    }
+
+    return HashBytes(packed, sizeof(packed)) ^ memory_hash ^ screen_hash;
+}
+
+bool Chip8::StateEquals(Chip8 const& other) const
+{
+    return std::equal(memory, memory + MEMORY_SIZE, other.memory)
+        && std::equal(std::begin(registers), std::end(registers), std::begin(other.registers))
+        && std::equal(std::begin(stack), std::end(stack), std::begin(other.stack))
+        && std::equal(std::begin(screen), std::end(screen), std::begin(other.screen))
+        && keypad == other.keypad
+        && key_wait == other.key_wait
+        && (!key_wait || key_wait_register == other.key_wait_register)
+        && program_counter == other.program_counter
+        && index_register == other.index_register
+        && stack_pointer == other.stack_pointer
+        && delay_timer == other.delay_timer
+        && sound_timer == other.sound_timer
+        && timer_phase == other.timer_phase
+        && rng_state == other.rng_state
+        && fault == other.fault;
 }
 
 void Chip8::fetch() 
 {
-    opcode = (memory[program_counter] << 8u) + memory[program_counter + 1];
+    uint16_t address = program_counter & ADDRESS_MASK;
+    current = decode((memory[address] << 8u) + memory[(address + 1) & ADDRESS_MASK]);
     increment_pc();
 }
 
@@ -151,59 +1016,141 @@ void Chip8::increment_pc()
     program_counter += 2;
 }
 
-void Chip8::load_rom(char const* filename) 
+void Chip8::halt(Fault reason)
 {
-    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    //Back onto the faulting instruction so the machine spins there
+    program_counter -= 2;
+    fault = reason;
+}
 
-    if(file.is_open())
-    {
-        std::streampos size = file.tellg();
-        char* buffer = new char[size];
+RomError Chip8::load_rom(char const* filename) 
+{
+    std::shared_ptr<Rom const> rom;
+    RomError error = RomCache::Global().Load(filename, rom);
 
+    if(error == RomError::None) {
+        load_image(rom->Data(), rom->Size(), rom->Hash());
+    }
+    return error;
+}
 
-        file.seekg(0, std::ios::beg);
-        file.read(buffer,size);
-        file.close();
+RomError Chip8::load_rom(uint8_t const* data, std::size_t size)
+{
+    if(size == 0) {
+        return RomError::Empty;
+    }
+    if(size > MAX_ROM_SIZE) {
+        return RomError::TooLarge;
+    }
 
-        for(long i = 0; i < size; i++) {
-            memory[START_ADD + i] = buffer[i];
-        }
+    load_image(data, size, HashBytes(data, size));
+    return RomError::None;
+}
+
+RomError Chip8::load_rom(Rom const& rom)
+{
+    //RomCache only hands out ROMs that fit
+    load_image(rom.Data(), rom.Size(), rom.Hash());
+    return RomError::None;
+}
+
+void Chip8::load_image(uint8_t const* data, std::size_t size, uint64_t hash)
+{
+    own_memory();
 
-        delete[] buffer;
+    std::memset(memory, 0, MEMORY_SIZE);
+    std::memcpy(memory + FONTSET_START_ADDRESS, font_sprites, sizeof(font_sprites));
+    std::memcpy(memory + START_ADD, data, size);
+
+    rom_image = image;
+    rom_hash = hash;
+    rehash_memory();
+    invalid_seen = false;
+
+    QuirkProfile known;
+    if(QuirkDatabase::Global().Find(hash, known)) {
+        quirks = known;
     }
+    select_quirks();
 }
 
-void Chip8::OP_00E0() 
+void Chip8::Reset()
+{
+    std::fill(std::begin(registers), std::end(registers), 0);
+    std::fill(std::begin(stack), std::end(stack), 0);
+    keypad = 0;
+    key_wait = false;
+    key_wait_register = 0;
+    std::fill(std::begin(screen), std::end(screen), 0);
+    program_counter = START_ADD;
+    index_register = 0;
+    stack_pointer = 0;
+    delay_timer = 0;
+    sound_timer = 0;
+    timer_phase = 0;
+    cycle_count = 0;
+    fault = Fault::None;
+    invalid_seen = false;
+    dirty_rows = 0xFFFFFFFFu;
+    reset_beeper();
+    compiled_stale = false;
+
+    //Sharing the pristine image is free; the next write takes a private copy
+    image = std::const_pointer_cast<MemoryImage>(rom_image);
+    memory = image->bytes;
+    rehash_memory();
+
+    invalidate_decoded();
+}
+
+void Chip8::OP_00E0(Instruction const&)
 {
     memset(screen, 0, sizeof(screen));
+    dirty_rows = 0xFFFFFFFFu;
 }
 
-void Chip8::OP_00EE()
+void Chip8::OP_00EE(Instruction const&)
 {
+    if(stack_pointer == 0) {
+        halt(Fault::StackUnderflow);
+        return;
+    }
+
     stack_pointer--;
     program_counter = stack[stack_pointer];
 }
 
-void Chip8::OP_1nnn()
+void Chip8::OP_1nnn(Instruction const& op)
 {
-    uint16_t address = opcode & 0x0FFFu;
-    
+    uint16_t address = op.nnn;
+
+    //Jumping back to the top of an idle loop ends the segment, so RunFor
+    //can skip the rest of the loop instead of waiting for the tick
+    if(idle_skip && jumps_into_idle_loop(program_counter - 2, address)) {
+        yield_requested = true;
+    }
+
     program_counter = address;
 }
 
-void Chip8::OP_2nnn()
+void Chip8::OP_2nnn(Instruction const& op)
 {
-    uint16_t address = opcode & 0x0FFFu;
+    uint16_t address = op.nnn;
+
+    if(stack_pointer >= std::size(stack)) {
+        halt(Fault::StackOverflow);
+        return;
+    }
 
     stack[stack_pointer] = program_counter;
     stack_pointer++;
     program_counter = address;
 }
 
-void Chip8::OP_3xkk()
+void Chip8::OP_3xkk(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t byte = opcode & 0x00FFu;
+    uint8_t Vx = op.x;
+    uint8_t byte = op.kk;
 
     if(registers[Vx] == byte)
     {
@@ -211,10 +1158,10 @@ void Chip8::OP_3xkk()
     }
 }
 
-void Chip8::OP_4xkk()
+void Chip8::OP_4xkk(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t byte = opcode & 0x00FFu;
+    uint8_t Vx = op.x;
+    uint8_t byte = op.kk;
 
     if(registers[Vx] != byte) 
     {
@@ -222,10 +1169,10 @@ void Chip8::OP_4xkk()
     }
 }
 
-void Chip8::OP_5xy0()
+void Chip8::OP_5xy0(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t Vx = op.x;
+    uint8_t Vy = op.y;
 
     if(registers[Vx] == registers[Vy]) 
     {
@@ -233,338 +1180,301 @@ void Chip8::OP_5xy0()
     }
 }
 
-void Chip8::OP_6xkk()
+void Chip8::OP_6xkk(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t byte = opcode & 0x00FFu;
+    uint8_t Vx = op.x;
+    uint8_t byte = op.kk;
 
     registers[Vx] = byte;
 }
 
-void Chip8::OP_7xkk()
+void Chip8::OP_7xkk(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t byte = opcode & 0x00FFu;
+    uint8_t Vx = op.x;
+    uint8_t byte = op.kk;
 
     registers[Vx] += byte;
 }
 
-void Chip8::OP_8xy0()
+void Chip8::OP_8xy0(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t Vx = op.x;
+    uint8_t Vy = op.y;
 
     registers[Vx] = registers[Vy];
 }
 
-void Chip8::OP_8xy1()
+template<typename Quirks>
+void Chip8::OP_8xy1(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t Vx = op.x;
+    uint8_t Vy = op.y;
 
     registers[Vx] = registers[Vx] | registers[Vy];
+
+    if(Quirks::LOGIC_RESETS_VF) {
+        registers[0xF] = 0;
+    }
 }
 
-void Chip8::OP_8xy2()
+template<typename Quirks>
+void Chip8::OP_8xy2(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t Vx = op.x;
+    uint8_t Vy = op.y;
+
+    registers[Vx] &= registers[Vy];
 
-    registers[Vx] %= registers[Vy];
+    if(Quirks::LOGIC_RESETS_VF) {
+        registers[0xF] = 0;
+    }
 }
 
-void Chip8::OP_8xy3()
+template<typename Quirks>
+void Chip8::OP_8xy3(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t Vx = op.x;
+    uint8_t Vy = op.y;
 
     registers[Vx] ^= registers[Vy];
+
+    if(Quirks::LOGIC_RESETS_VF) {
+        registers[0xF] = 0;
+    }
 }
 
-void Chip8::OP_8xy4()
+void Chip8::OP_8xy4(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t Vx = op.x;
+    uint8_t Vy = op.y;
 
     uint16_t sum = registers[Vx] + registers[Vy];
 
-    if(sum > 0x00FFu) {
-        registers[0xF] = 1; //Carry bit
-    }
-    else {
-        registers[0xF] = 0;
-    }
-    registers[Vx] = sum % 0xFFu;
+    //VF is written last so it holds the flag even when x is F
+    registers[Vx] = sum & 0xFFu;
+    registers[0xF] = sum > 0x00FFu ? 1 : 0; //Carry bit
 }
 
-void Chip8::OP_8xy5()
+void Chip8::OP_8xy5(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t Vx = op.x;
+    uint8_t Vy = op.y;
 
-    if(registers[Vx] > registers[Vy]) {
-        registers[0xF] = 1; 
-    }
-    else {
-        registers[0xF] = 0;
-    }
+    //No borrow when equal as well
+    uint8_t flag = registers[Vx] >= registers[Vy] ? 1 : 0;
 
     registers[Vx] -= registers[Vy];
+    registers[0xF] = flag;
 }
 
-void Chip8::OP_8xy6()
+template<typename Quirks>
+void Chip8::OP_8xy6(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    
+    uint8_t Vx = op.x;
+    uint8_t source = Quirks::SHIFT_FROM_VY ? op.y : Vx;
+
     //Saves least significant bit in register VF
-    registers[0xF] = (registers[Vx] & 0x1u); 
+    uint8_t flag = registers[source] & 0x1u;
 
-    registers[Vx] >>= 1u;
+    registers[Vx] = registers[source] >> 1u;
+    registers[0xF] = flag;
 }
 
-void Chip8::OP_8xy7()
+void Chip8::OP_8xy7(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t Vx = op.x;
+    uint8_t Vy = op.y;
 
-    if(registers[Vy] > registers[Vx]) {
-        registers[0xF] = 1;
-    }
-    else {
-        registers[0xF] = 0;
-    }
+    uint8_t flag = registers[Vy] >= registers[Vx] ? 1 : 0;
 
     registers[Vx] = registers[Vy] - registers[Vx];
+    registers[0xF] = flag;
 }
 
-void Chip8::OP_8xyE()
+template<typename Quirks>
+void Chip8::OP_8xyE(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t Vx = op.x;
+    uint8_t source = Quirks::SHIFT_FROM_VY ? op.y : Vx;
 
-    registers[0xF] = (registers[Vx] & 0x80u) >> 7u; //0x80u is 128 (10000000);
+    uint8_t flag = (registers[source] & 0x80u) >> 7u; //0x80u is 128 (10000000);
 
-    registers[Vx] <<= 2;
+    registers[Vx] = registers[source] << 1u;
+    registers[0xF] = flag;
 }
 
-void Chip8::OP_9xy0()
+void Chip8::OP_9xy0(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t Vx = op.x;
+    uint8_t Vy = op.y;
 
     if(registers[Vx] != registers[Vy]) {
         program_counter += 2;
     }
 }
 
-void Chip8::OP_Annn() 
+void Chip8::OP_Annn(Instruction const& op) 
 {
-    uint16_t NNN = opcode & 0x0FFFu;
+    uint16_t NNN = op.nnn;
 
     index_register = NNN;
 }
 
-void Chip8::OP_Bnnn()
+template<typename Quirks>
+void Chip8::OP_Bnnn(Instruction const& op)
 {
-    uint16_t NNN = opcode & 0x0FFFu;
+    uint16_t NNN = op.nnn;
 
-    program_counter = NNN + registers[0];
+    //CHIP-48 and SUPER-CHIP read this as Bxnn, jumping to xnn + Vx
+    program_counter = NNN + registers[Quirks::JUMP_USES_VX ? op.x : 0];
 }
 
-void Chip8::OP_Cxkk()
+void Chip8::OP_Cxkk(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t byte = opcode & 0x00FFu;
+    uint8_t Vx = op.x;
+    uint8_t byte = op.kk;
 
-    registers[Vx] = randByte(randGen) & byte;
+    registers[Vx] = random_byte() & byte;
 }
 
-void Chip8::OP_Dxyn()
+template<typename Quirks>
+void Chip8::OP_Dxyn(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
-    uint8_t height = opcode & 0x000Fu;
+    uint8_t Vx = op.x;
+    uint8_t Vy = op.y;
+    uint8_t height = op.n;
 
-    uint8_t xPos = registers[Vx] % VIDEO_HEIGHT;
-    uint8_t yPos = registers[Vy] % VIDEO_WIDTH;
+    uint8_t xPos = registers[Vx] % VIDEO_WIDTH;
+    uint8_t yPos = registers[Vy] % VIDEO_HEIGHT;
 
+    uint8_t sprite[15];
     for(int row = 0; row < height; row++) {
-        uint8_t spriteByte = memory[index_register + row];
-        for(int col = 0; col < 8; col++) {
-            uint8_t spritePixel = spriteByte & (0x80u >> col);
-            uint32_t* screenPixel = &screen[(yPos + row) * VIDEO_WIDTH + (xPos + col)]; 
-            
-            if(spritePixel) {
-                if(*screenPixel == 0xFFFFFFFF);
-                registers[0xF] = 1; 
-            }
-
-            *screenPixel ^= 0xFFFFFFFF;
-        }
+        sprite[row] = memory[(index_register + row) & ADDRESS_MASK];
     }
+
+    registers[0xF] = DrawSprite(screen, sprite, height, xPos, yPos, Quirks::WRAP_SPRITES, dirty_rows) ? 1 : 0;
 }
 
-void Chip8::OP_Ex9E()
+void Chip8::OP_Ex9E(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t key = registers[Vx];
+    uint8_t Vx = op.x;
+    uint8_t key = registers[Vx] & 0xFu;
 
-    if(keypad[key])
+    if(keypad & (1u << key))
     {
         program_counter += 2;
     }
 }
 
-void Chip8::OP_ExA1()
+void Chip8::OP_ExA1(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t Vx = op.x;
 
-    uint8_t key = registers[Vx];
+    uint8_t key = registers[Vx] & 0xFu;
 
-    if(!keypad[key])
+    if(!(keypad & (1u << key)))
     {
         program_counter += 2;
     }
 }
 
-void Chip8::OP_Fx07()
+void Chip8::OP_Fx07(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t Vx = op.x;
 
     registers[Vx] = delay_timer;
 }
 
-void Chip8::OP_Fx0A()
-{
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-
-	if (keypad[0])
-	{
-		registers[Vx] = 0;
-	}
-	else if (keypad[1])
-	{
-		registers[Vx] = 1;
-	}
-	else if (keypad[2])
-	{
-		registers[Vx] = 2;
-	}
-	else if (keypad[3])
-	{
-		registers[Vx] = 3;
-	}
-	else if (keypad[4])
-	{
-		registers[Vx] = 4;
-	}
-	else if (keypad[5])
-	{
-		registers[Vx] = 5;
-	}
-	else if (keypad[6])
-	{
-		registers[Vx] = 6;
-	}
-	else if (keypad[7])
-	{
-		registers[Vx] = 7;
-	}
-	else if (keypad[8])
-	{
-		registers[Vx] = 8;
-	}
-	else if (keypad[9])
-	{
-		registers[Vx] = 9;
-	}
-	else if (keypad[10])
-	{
-		registers[Vx] = 10;
-	}
-	else if (keypad[11])
-	{
-		registers[Vx] = 11;
-	}
-	else if (keypad[12])
-	{
-		registers[Vx] = 12;
-	}
-	else if (keypad[13])
-	{
-		registers[Vx] = 13;
-	}
-	else if (keypad[14])
-	{
-		registers[Vx] = 14;
-	}
-	else if (keypad[15])
-	{
-		registers[Vx] = 15;
-	}
-	else
-	{
-		program_counter -= 2;
-	}
-}
-
-
-void Chip8::OP_Fx15()
-{
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx0A(Instruction const& op)
+{
+    //Blocks until SetKeys reports a newly pressed key. The PC stays on this
+    //instruction meanwhile, so running it again changes nothing.
+    key_wait = true;
+    key_wait_register = op.x;
+    yield_requested = true;
+    program_counter -= 2;
+}
+
+void Chip8::OP_Fx15(Instruction const& op)
+{
+    uint8_t Vx = op.x;
 
     delay_timer = registers[Vx];
 }
 
-void Chip8::OP_Fx18()
+void Chip8::OP_Fx18(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t Vx = op.x;
 
     sound_timer = registers[Vx];
+
+    //Stop so RunFor logs the edge at this instruction's cycle
+    if((sound_timer > 0) != beeper_on) {
+        yield_requested = true;
+    }
 } 
 
-void Chip8::OP_Fx1E()
+void Chip8::OP_Fx1E(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t Vx = op.x;
 
     index_register += registers[Vx];
 }
 
-void Chip8::OP_Fx29()
+void Chip8::OP_Fx29(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t Vx = op.x;
     uint8_t digit = registers[Vx];
 
     index_register = FONTSET_START_ADDRESS + (5 * digit); //font character is 5 bytes
 }
 
-void Chip8::OP_Fx33()
+void Chip8::OP_Fx33(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t Vx = op.x;
     uint8_t value = registers[Vx];
 
-    memory[index_register] = value % 10; //ones place
+    //Memory holds the most significant digit first, at I; the digits are
+    //peeled off from the ones place, so they are written from I+2 down
+    write_memory(index_register + 2, value % 10); //ones place
     value /= 10;
 
-    memory[index_register + 1] = value % 10; //tens place
+    write_memory(index_register + 1, value % 10); //tens place
     value /= 10;
 
-    memory[index_register + 2] = value % 10; // hundreds place
+    write_memory(index_register, value % 10); // hundreds place
 }
 
-void Chip8::OP_Fx55()
+template<typename Quirks>
+void Chip8::OP_Fx55(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t Vx = op.x;
 
     for(uint8_t i = 0; i<= Vx; i++) {
-        memory[index_register + i] = registers[i];
+        write_memory(index_register + i, registers[i]);
+    }
+
+    if(Quirks::LOAD_STORE_INDEX == IndexQuirk::AddX) {
+        index_register += Vx;
+    }
+    else if(Quirks::LOAD_STORE_INDEX == IndexQuirk::AddXPlusOne) {
+        index_register += Vx + 1;
     }
 }
 
-void Chip8::OP_Fx65()
+template<typename Quirks>
+void Chip8::OP_Fx65(Instruction const& op)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t Vx = op.x;
 
     for(uint8_t i = 0; i <= Vx; i++) {
-        registers[i] = memory[index_register + i];
+        registers[i] = memory[(index_register + i) & ADDRESS_MASK];
+    }
+
+    if(Quirks::LOAD_STORE_INDEX == IndexQuirk::AddX) {
+        index_register += Vx;
+    }
+    else if(Quirks::LOAD_STORE_INDEX == IndexQuirk::AddXPlusOne) {
+        index_register += Vx + 1;
     }
 }
@@ -1,120 +1,543 @@
 #pragma once 
+#include <cstddef>
 #include <cstdint>
-#include <chrono>
-#include <random>
+#include <memory>
+#include <vector>
+#include "Quirks.h"
+#include "Rom.h"
 
 const unsigned int VIDEO_HEIGHT = 32;
 const unsigned int VIDEO_WIDTH = 64;
 const unsigned int KEY_COUNT = 16;
+const unsigned int MEMORY_SIZE = 4096;
+const unsigned int ADDRESS_MASK = MEMORY_SIZE - 1;
+const unsigned int START_ADD = 0x200;
+const unsigned int FONTSET_START_ADDRESS = 0x50;
+const unsigned int MAX_ROM_SIZE = MEMORY_SIZE - START_ADD;
+const unsigned int TIMER_RATE = 60;
+const unsigned int DEFAULT_CLOCK_RATE = 600;
+const uint64_t DEFAULT_SEED = 0x43484950u;
+
+enum class Engine {
+    Table,    //Reference interpreter, Cycle()
+    Cached,   //Decode cache, CycleCached()
+    Threaded, //Chained basic blocks of pre-decoded handlers
+    Compiled, //Native code from the recompile tool, see Compiled.h
+    Jit       //x86-64 code for hot blocks, generated at run time, see Jit.h
+};
+
+struct CompiledRom;
+class JitCode;
+
+//Why a machine stopped; a halted machine re-executes the faulting
+//instruction, which faults again without changing any other state
+enum class Fault : uint8_t {
+    None,
+    StackOverflow,   //2nnn with all 16 stack entries in use
+    StackUnderflow   //00EE with an empty stack
+};
+
+//The beeper switching on or off, at GetCycleCount() as it was right after
+//the instruction or timer tick that caused it
+struct BeeperEdge {
+    uint64_t cycle;
+    bool on;
+};
+
 class Chip8 {
     public:
-        Chip8();
+        friend class CompiledRuntime;
+        friend class JitCode;
+
+        //Cxkk draws from a PRNG seeded here, so a seed, a ROM and the
+        //keypad input fully determine a run
+        explicit Chip8(uint64_t seed = DEFAULT_SEED);
 
+        void Seed(uint64_t seed);
+
+        //Reference path: fetch, decode and two-level table dispatch
         void Cycle();
 
-        void load_rom(char const* file);
+        //Cycle() with hooks for a policy from Profiler.h; instantiated for
+        //NullProfiler and InstructionProfiler
+        template<typename Profiler>
+        void Cycle(Profiler& profiler);
+
+        //Same semantics as Cycle() but dispatches through the decode cache
+        void CycleCached();
+
+        void SetEngine(Engine engine);
+
+        Engine GetEngine() const { return engine; }
+
+        //Instructions per emulated second; timers always tick at TIMER_RATE
+        void SetClockRate(uint32_t hz);
+
+        uint32_t GetClockRate() const { return clock_rate; }
+
+        //Executes cycles instructions on the selected engine, ticking the
+        //timers whenever emulated time crosses a 60 Hz boundary
+        void RunFor(uint64_t cycles);
+
+        //Profiled runs always use the reference path so every instruction
+        //is observed
+        template<typename Profiler>
+        void RunFor(uint64_t cycles, Profiler& profiler);
+
+        //Runs up to and including the next timer tick, returns cycles run
+        uint64_t RunUntilFrame();
+
+        template<typename Profiler>
+        uint64_t RunUntilFrame(Profiler& profiler);
+
+        uint64_t CyclesUntilTimerTick() const;
+
+        uint64_t GetCycleCount() const { return cycle_count; }
+
+        //RunFor skips whole iterations of idle loops up to the next timer
+        //tick: a 1nnn jumping to itself, or Fx07 / 3xkk or 4xkk / 1nnn
+        //polling the delay timer. The state afterwards is the same as
+        //running them. On by default.
+        void SetIdleSkip(bool enabled) { idle_skip = enabled; }
+
+        //Cycles RunFor skipped instead of running
+        uint64_t GetSkippedCycles() const { return skipped_cycles; }
+
+        Fault GetFault() const { return fault; }
+
+        //A faulted machine stays on the faulting instruction
+        uint16_t GetProgramCounter() const { return program_counter; }
+
+        //Opcodes with no handler run as no-ops. The first one run since
+        //loading or Reset is kept for Watchdog; false if there was none.
+        bool GetInvalidOpcode(uint16_t& address, uint16_t& opcode) const;
+
+        //Hash of everything StateEquals compares. The memory part is updated
+        //on every store; screen rows changed since the last call and the
+        //registers are hashed on each call.
+        uint64_t GetStateHash() const;
+
+        //The beeper sounds while the sound timer is nonzero
+        bool IsSoundOn() const { return sound_timer > 0; }
+
+        static const std::size_t MAX_BEEPER_EDGES = 32;
+
+        //Beeper transitions since the last ClearBeeperEdges, oldest first,
+        //always alternating. A full log merges the newest edges away but
+        //still ends in the right state. Restoring state clears the log.
+        BeeperEdge const* GetBeeperEdges() const { return beeper_edges; }
+
+        std::size_t GetBeeperEdgeCount() const { return beeper_edge_count; }
+
+        void ClearBeeperEdges() { beeper_edge_count = 0; }
+
+        //Switches the handlers that differ between interpreters. Loading a
+        //ROM listed in QuirkDatabase::Global() selects its profile.
+        void SetQuirks(QuirkProfile profile);
+
+        QuirkProfile GetQuirks() const { return quirks; }
+
+        //Sprites clip at the screen edges by default, or wrap around
+        void SetSpriteWrap(bool wrap);
+
+        bool GetSpriteWrap() const { return wrap_sprites; }
 
-        uint8_t keypad[KEY_COUNT] {};
+        //True when the architectural state of both machines is identical
+        bool StateEquals(Chip8 const& other) const;
 
-        uint32_t screen[VIDEO_WIDTH * VIDEO_HEIGHT] {};
+        //Loading replaces all of memory with the font, the ROM and zeroes;
+        //files go through RomCache so each path is read only once
+        RomError load_rom(char const* file);
+
+        RomError load_rom(uint8_t const* data, std::size_t size);
+
+        RomError load_rom(Rom const& rom);
+
+        //Back to power-on state with memory as it was after load_rom; the
+        //PRNG carries on unless reseeded
+        void Reset();
+
+        //Held keys, bit n for key n. A key that was not held before ends
+        //an Fx0A wait.
+        void SetKeys(uint16_t keys);
+
+        uint16_t GetKeys() const { return keypad; }
+
+        //Fx0A is blocked on a key press; RunFor only advances time meanwhile
+        bool IsWaitingForKey() const { return key_wait; }
+
+        //One bit per pixel, bit 63 of each row is the leftmost column
+        uint64_t screen[VIDEO_HEIGHT] {};
+
+        //Expands the rows drawn to since the last call into RGBA8888 pixels
+        //(VIDEO_WIDTH * VIDEO_HEIGHT of them) and returns their row mask;
+        //0 means the frame is unchanged and nothing was written
+        uint32_t PresentScreen(uint32_t* rgba);
+
+        //The expansion PresentScreen uses, for hosts holding a copy of screen
+        static void ExpandScreen(uint64_t const* rows, uint32_t rowMask, uint32_t* rgba);
+
+        //HashBytes of the display packed 8 pixels per byte, leftmost pixel in
+        //the top bit, rows top to bottom; independent of host byte order
+        uint64_t GetScreenHash() const;
+
+        //GetScreenHash of any VIDEO_HEIGHT rows in the screen's layout
+        static uint64_t HashScreen(uint64_t const* rows);
+
+        //Upper bound on the size of a SaveState snapshot
+        static const std::size_t MAX_STATE_SIZE = 4608;
+
+        //Writes a versioned snapshot into buffer without allocating. Memory
+        //is stored as a delta against the loaded ROM, so the ROM has to be
+        //loaded again before LoadState. Returns the bytes written, or 0 if
+        //capacity is too small.
+        std::size_t SaveState(uint8_t* buffer, std::size_t capacity) const;
+
+        //Restores a SaveState snapshot; false if it is malformed, from another
+        //format version or taken with a different ROM
+        bool LoadState(uint8_t const* data, std::size_t size);
+
+        //Everything a run can change, as plain arrays so capturing and
+        //restoring never allocate. Unlike SaveState this is an in-memory
+        //rollback point for the same machine, ROM and settings.
+        struct Snapshot {
+            uint8_t memory[MEMORY_SIZE];
+            uint8_t registers[16];
+            uint16_t stack[16];
+            uint16_t program_counter;
+            uint16_t index_register;
+            uint8_t stack_pointer;
+            uint8_t delay_timer;
+            uint8_t sound_timer;
+            uint16_t keypad;
+            bool key_wait;
+            uint8_t key_wait_register;
+            Fault fault;
+            uint32_t timer_phase;
+            uint64_t cycle_count;
+            uint64_t rng_state;
+            uint64_t screen[VIDEO_HEIGHT];
+            uint32_t dirty_rows;
+        };
+
+        void Capture(Snapshot& snapshot) const;
+
+        //Only bytes that differ are written back, so decoded instructions
+        //and translated blocks survive unless the run modified code
+        void Restore(Snapshot const& snapshot);
+
+        //Copy-on-write fork: the copy shares memory with this machine until
+        //either side writes to it, and rebuilds its decode caches on demand
+        Chip8 Fork() const { return *this; }
+
+        static uint64_t HashBytes(uint8_t const* data, std::size_t size);
+
+        uint64_t GetRomHash() const { return rom_hash; }
     private:
+        struct MemoryImage {
+            uint8_t bytes[MEMORY_SIZE];
+        };
+
+        //Shared with forks and with rom_image until the first write
+        std::shared_ptr<MemoryImage> image;
+        uint8_t* memory;
+
+        //Memory as it was right after loading, the base for state deltas
+        std::shared_ptr<MemoryImage const> rom_image;
+        uint64_t rom_hash {};
+
         uint8_t registers[16] {};
         uint16_t program_counter {};
         uint16_t index_register {};
         uint8_t stack_pointer {};
+        uint16_t keypad {};
+
+        //Set by Fx0A until SetKeys sees a key go down
+        bool key_wait {};
+
+        //Set by a handler that needs the engines to stop right after it, for
+        //Fx0A blocking and for Fx18 switching the beeper
+        bool yield_requested {};
+        uint8_t key_wait_register {};  //Only meaningful while key_wait is set
         uint8_t delay_timer {};
         uint8_t sound_timer {};
         uint16_t stack[16] {};
-        uint16_t opcode;
-
-        std::default_random_engine randGen;
-        std::uniform_int_distribution<uint8_t> randByte;
-
-        typedef void (Chip8::*Chip8Func)();
-        Chip8Func table[0xF + 1]{&Chip8::OP_NULL};
-        Chip8Func table0[0xE + 1]{&Chip8::OP_NULL};
-        Chip8Func table8[0xE + 1]{&Chip8::OP_NULL};
-        Chip8Func tableE[0xE + 1]{&Chip8::OP_NULL};
-        Chip8Func tableF[0x65 + 1]{&Chip8::OP_NULL};
-
-        void Table0();
-        void Table8();
-        void TableE();
-        void TableF();
+
+        uint32_t clock_rate {DEFAULT_CLOCK_RATE};
+
+        //Emulated time since the last timer tick, in units of 1/(clock_rate * TIMER_RATE) s
+        uint32_t timer_phase {};
+        uint64_t cycle_count {};
+
+        //Beeper state as of the last edge logged; equal to sound_timer > 0
+        //between instructions
+        bool beeper_on {};
+        uint8_t beeper_edge_count {};
+        BeeperEdge beeper_edges[MAX_BEEPER_EDGES] {};
+
+        //Rows changed since the last PresentScreen, bit n for row n
+        uint32_t dirty_rows {0xFFFFFFFFu};
+
+        bool idle_skip {true};
+        uint64_t skipped_cycles {};
+
+        bool invalid_seen {};
+        uint16_t invalid_address {};
+        uint16_t invalid_opcode {};
+
+        //XOR of memory_term over every byte of memory
+        uint64_t memory_hash {};
+
+        //XOR of row_term over every row of hashed_rows, the screen as of the
+        //last GetStateHash
+        mutable uint64_t screen_hash {};
+        mutable uint64_t hashed_rows[VIDEO_HEIGHT] {};
+
+        static uint64_t memory_term(uint16_t address, uint8_t value);
+
+        static uint64_t row_term(unsigned int row, uint64_t bits);
+
+        void rehash_memory();
+
+        QuirkProfile quirks {QuirkProfile::CosmacVip};
+        Fault fault {Fault::None};
+        bool wrap_sprites {};
+
+        //Translation of this ROM for the current quirks, if one is linked in
+        CompiledRom const* compiled {};
+        bool compiled_stale {};
+
+        //xorshift64 state, never zero
+        uint64_t rng_state {};
+
+        uint8_t random_byte();
+
+        struct Instruction;
+        typedef void (Chip8::*Chip8Func)(Instruction const&);
+
+        //Opcode with its operand fields already extracted
+        struct Instruction {
+            Chip8Func handler;
+            uint16_t opcode;
+            uint16_t nnn;
+            uint8_t x;
+            uint8_t y;
+            uint8_t kk;
+            uint8_t n;
+        };
+
+        Chip8Func table[0xF + 1];
+        Chip8Func table0[0xF + 1];
+        Chip8Func table8[0xF + 1];
+        Chip8Func tableE[0xF + 1];
+        Chip8Func tableF[0xFF + 1];
+
+        Instruction current {};
+
+        //Straight-line run of instructions ending at a branch, skip or store
+        struct Block {
+            uint16_t start;
+            uint16_t length;
+            uint32_t first;
+
+            //Last successor taken, so hot edges skip the block_index lookup
+            uint16_t chain_pc;
+            uint32_t chain_block;
+        };
+
+        //Defined with JitCode, so Chip8.h does not need its definition
+        struct JitDeleter {
+            void operator()(JitCode* code) const;
+        };
+
+        //Everything derived from memory contents. Copies start out empty and
+        //are rebuilt on demand, which keeps copying a Chip8 cheap.
+        struct TranslationCache {
+            //One slot per address once allocated, filled lazily by OP_Decode
+            std::vector<Instruction> decoded;
+
+            std::vector<Block> blocks;
+            std::vector<Instruction> block_code;
+
+            //Block number + 1 starting at each address, 0 when not translated
+            std::vector<uint32_t> block_index;
+
+            //Addresses covered by at least one translated block
+            std::vector<uint8_t> code_map;
+            bool code_dirty {};
+
+            //Native blocks for Engine::Jit, with 1 for every byte they were
+            //translated from; a store to such a byte sets jit_dirty
+            std::unique_ptr<JitCode, JitDeleter> jit;
+            std::vector<uint8_t> jit_code;
+            bool jit_dirty {};
+
+            TranslationCache() = default;
+            TranslationCache(TranslationCache const&) {}
+            TranslationCache& operator=(TranslationCache const&);
+        };
+
+        Engine engine {Engine::Table};
+
+        TranslationCache cache;
+
+        void Table0(Instruction const& op);
+        void Table8(Instruction const& op);
+        void TableE(Instruction const& op);
+        void TableF(Instruction const& op);
         
         void fetch();
 
+        Instruction decode(uint16_t opcode) const;
+
+        Chip8Func resolve(uint16_t opcode) const;
+
+        void write_memory(uint16_t address, uint8_t value);
+
+        void invalidate_decoded();
+
+        void allocate_decoded();
+
+        void allocate_blocks();
+
+        void own_memory();
+
+        void load_image(uint8_t const* data, std::size_t size, uint64_t hash);
+
+        void tick_timers(uint64_t cycle);
+
+        void advance_clock(uint64_t cycles);
+
+        //Returns the instructions run, fewer than count after a yield
+        uint64_t execute(uint64_t count);
+
+        void finish_yield();
+
+        //Cycles of segment RunFor can skip because the pc is at the top of
+        //an idle loop that cannot leave before the next tick. Inside such a
+        //loop but not at its top, sets lead to the instructions until the
+        //top instead.
+        uint64_t skip_idle_loop(uint64_t segment, uint64_t& lead);
+
+        uint16_t opcode_at(uint16_t address) const;
+
+        //top starts an Fx07 / 3xkk or 4xkk / 1nnn delay timer poll
+        bool polls_delay_timer(uint16_t top) const;
+
+        //A 1nnn at address going to target closes one of those loops, or
+        //jumps to itself
+        bool jumps_into_idle_loop(uint16_t address, uint16_t target) const;
+
+        void log_beeper_edge(uint64_t cycle, bool on);
+
+        //Forgets edges and resyncs beeper_on after the state was replaced
+        void reset_beeper();
+
+        //Points the quirk-dependent table entries at one instantiation
+        template<typename Quirks>
+        void install_quirks();
+
+        void select_quirks();
+
+        bool ends_block(Chip8Func handler) const;
+
+        uint32_t translate_block(uint16_t start);
+
+        void flush_blocks();
+
+        uint64_t run_blocks(uint64_t count);
+
+        uint64_t run_compiled(uint64_t count);
+
+        uint64_t run_jit(uint64_t count);
+
+        //Rechecks translated code against memory after it was replaced
+        void check_compiled();
+
         void increment_pc();
 
-        void OP_NULL();
+        void halt(Fault reason);
+
+        void OP_NULL(Instruction const& op);
+
+        void OP_Decode(Instruction const& op);
         
-        void OP_00E0();
+        void OP_00E0(Instruction const& op);
 
-        void OP_00EE();
+        void OP_00EE(Instruction const& op);
 
-        void OP_1nnn();
+        void OP_1nnn(Instruction const& op);
 
-        void OP_2nnn();
+        void OP_2nnn(Instruction const& op);
 
-        void OP_3xkk();
+        void OP_3xkk(Instruction const& op);
 
-        void OP_4xkk();
+        void OP_4xkk(Instruction const& op);
 
-        void OP_5xy0();
+        void OP_5xy0(Instruction const& op);
 
-        void OP_6xkk();
+        void OP_6xkk(Instruction const& op);
 
-        void OP_7xkk();
+        void OP_7xkk(Instruction const& op);
 
-        void OP_8xy0();
+        void OP_8xy0(Instruction const& op);
 
-        void OP_8xy1();
+        template<typename Quirks>
+        void OP_8xy1(Instruction const& op);
 
-        void OP_8xy2();
+        template<typename Quirks>
+        void OP_8xy2(Instruction const& op);
 
-        void OP_8xy3();
+        template<typename Quirks>
+        void OP_8xy3(Instruction const& op);
 
-        void OP_8xy4();
+        void OP_8xy4(Instruction const& op);
 
-        void OP_8xy5();
+        void OP_8xy5(Instruction const& op);
 
-        void OP_8xy6();
+        template<typename Quirks>
+        void OP_8xy6(Instruction const& op);
 
-        void OP_8xy7();
+        void OP_8xy7(Instruction const& op);
 
-        void OP_8xyE();
+        template<typename Quirks>
+        void OP_8xyE(Instruction const& op);
 
-        void OP_9xy0();
+        void OP_9xy0(Instruction const& op);
 
-        void OP_Annn();
+        void OP_Annn(Instruction const& op);
 
-        void OP_Bnnn();
+        template<typename Quirks>
+        void OP_Bnnn(Instruction const& op);
 
-        void OP_Cxkk();
+        void OP_Cxkk(Instruction const& op);
 
-        void OP_Dxyn();
+        template<typename Quirks>
+        void OP_Dxyn(Instruction const& op);
 
-        void OP_Ex9E();
+        void OP_Ex9E(Instruction const& op);
 
-        void OP_ExA1();
+        void OP_ExA1(Instruction const& op);
 
-        void OP_Fx07();
+        void OP_Fx07(Instruction const& op);
 
-        void OP_Fx0A();
+        void OP_Fx0A(Instruction const& op);
 
-        void OP_Fx15();
+        void OP_Fx15(Instruction const& op);
 
-        void OP_Fx18();
+        void OP_Fx18(Instruction const& op);
 
-        void OP_Fx1E();
+        void OP_Fx1E(Instruction const& op);
 
-        void OP_Fx29();
+        void OP_Fx29(Instruction const& op);
 
-        void OP_Fx33();
+        void OP_Fx33(Instruction const& op);
 
-        void OP_Fx55();
+        template<typename Quirks>
+        void OP_Fx55(Instruction const& op);
 
-        void OP_Fx65();
+        template<typename Quirks>
+        void OP_Fx65(Instruction const& op);
 
         
 };
\ No newline at end of file
@@ -0,0 +1,765 @@
+#include "Chip8Batch.h"
+#include "Sprite.h"
+#include <cstring>
+#include <iterator>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CHIP8_BATCH_AVX2
+#include <immintrin.h>
+#endif
+
+namespace {
+
+unsigned int lowest_lane(uint32_t lanes)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned int>(__builtin_ctz(lanes));
+#else
+    unsigned int lane = 0;
+    while(!(lanes & (1u << lane))) {
+        lane++;
+    }
+    return lane;
+#endif
+}
+
+unsigned int lane_total(uint32_t lanes)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned int>(__builtin_popcount(lanes));
+#else
+    unsigned int total = 0;
+    for(; lanes != 0; lanes &= lanes - 1) {
+        total++;
+    }
+    return total;
+#endif
+}
+
+#ifdef CHIP8_BATCH_AVX2
+
+//0xFF in the byte of every lane in lanes
+__attribute__((target("avx2")))
+__m256i byte_mask(uint32_t lanes)
+{
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_set1_epi64x(static_cast<long long>(0x8040201008040201ull));
+
+    __m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(lanes)), spread);
+    return _mm256_cmpeq_epi8(_mm256_and_si256(bytes, bits), bits);
+}
+
+//0xFFFF in the word of every lane in lanes, for a row of 16 lanes
+__attribute__((target("avx2")))
+__m256i word_mask(uint32_t lanes)
+{
+    const __m256i bits = _mm256_setr_epi16(0x1, 0x2, 0x4, 0x8, 0x10, 0x20, 0x40, 0x80, 0x100, 0x200, 0x400,
+                                           0x800, 0x1000, 0x2000, 0x4000, static_cast<short>(0x8000));
+
+    __m256i words = _mm256_set1_epi16(static_cast<short>(lanes));
+    return _mm256_cmpeq_epi16(_mm256_and_si256(words, bits), bits);
+}
+
+__attribute__((target("avx2")))
+__m256i load(void const* row)
+{
+    return _mm256_load_si256(static_cast<__m256i const*>(row));
+}
+
+__attribute__((target("avx2")))
+void store(void* row, __m256i value)
+{
+    _mm256_store_si256(static_cast<__m256i*>(row), value);
+}
+
+//Writes value into the lanes of mask, leaves the others alone
+__attribute__((target("avx2")))
+void blend(void* row, __m256i value, __m256i mask)
+{
+    store(row, _mm256_blendv_epi8(load(row), value, mask));
+}
+
+//A row of 16-bit fields, as two halves of 16 lanes
+__attribute__((target("avx2")))
+void blend_words(uint16_t* row, __m256i low, __m256i high, uint32_t lanes)
+{
+    blend(row, low, word_mask(lanes & 0xFFFFu));
+    blend(row + 16, high, word_mask(lanes >> 16));
+}
+
+//Every lane of a group is at the same address, so pc changes are broadcasts
+__attribute__((target("avx2")))
+void set_pc(uint16_t* row, uint32_t lanes, uint16_t value)
+{
+    __m256i target = _mm256_set1_epi16(static_cast<short>(value));
+    blend_words(row, target, target, lanes);
+}
+
+//Moves group past the instruction at address, and past the next one too
+//in the lanes where taken is 0xFF
+__attribute__((target("avx2")))
+void skip_if(uint16_t* row, uint32_t group, uint16_t address, __m256i taken)
+{
+    uint32_t skipped = static_cast<uint32_t>(_mm256_movemask_epi8(taken)) & group;
+    set_pc(row, group & ~skipped, static_cast<uint16_t>(address + 2));
+    set_pc(row, skipped, static_cast<uint16_t>(address + 4));
+}
+
+__attribute__((target("avx2")))
+uint32_t lanes_equal(uint16_t const* row, uint16_t value)
+{
+    __m256i wanted = _mm256_set1_epi16(static_cast<short>(value));
+    __m256i low = _mm256_cmpeq_epi16(load(row), wanted);
+    __m256i high = _mm256_cmpeq_epi16(load(row + 16), wanted);
+
+    //packs interleaves the halves per 128-bit lane; the permute restores lane order
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8);
+    return static_cast<uint32_t>(_mm256_movemask_epi8(packed));
+}
+
+#endif
+
+}
+
+template<typename Quirks>
+Chip8Batch::Policy Chip8Batch::make_policy(bool wrapSprites)
+{
+    return Policy {Quirks::SHIFT_FROM_VY, Quirks::LOGIC_RESETS_VF, Quirks::LOAD_STORE_INDEX, Quirks::JUMP_USES_VX,
+                   wrapSprites};
+}
+
+Chip8Batch::Chip8Batch(QuirkProfile quirks, bool wrapSprites, uint32_t clockRate)
+    : quirks(quirks),
+      clock_rate(clockRate > 0 ? clockRate : 1)
+{
+    switch(quirks)
+    {
+        case QuirkProfile::Chip48: policy = make_policy<Chip48Quirks>(wrapSprites); break;
+        case QuirkProfile::SuperChip: policy = make_policy<SuperChipQuirks>(wrapSprites); break;
+        default: policy = make_policy<CosmacVipQuirks>(wrapSprites); break;
+    }
+    vector_path = HasVectorPath();
+}
+
+bool Chip8Batch::HasVectorPath()
+{
+#ifdef CHIP8_BATCH_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+bool Chip8Batch::Load(std::size_t lane, Chip8 const& machine)
+{
+    if(lane >= LANES || machine.GetQuirks() != quirks || machine.GetSpriteWrap() != policy.wrapSprites ||
+       machine.GetClockRate() != clock_rate) {
+        return false;
+    }
+
+    Chip8::Snapshot snapshot;
+    machine.Capture(snapshot);
+
+    if(loaded != 0 && (snapshot.cycle_count != cycle_count || snapshot.timer_phase != timer_phase)) {
+        return false;
+    }
+
+    //Opcodes are fetched once per group only where all lanes agree
+    if(loaded != 0)
+    {
+        uint8_t const* other = memory[lowest_lane(loaded)];
+        for(unsigned int address = 0; address < MEMORY_SIZE; address++) {
+            if(snapshot.memory[address] != other[address]) {
+                diverged[address] = 1;
+            }
+        }
+    }
+    std::memcpy(memory[lane], snapshot.memory, MEMORY_SIZE);
+    std::memcpy(screen[lane], snapshot.screen, sizeof(screen[lane]));
+
+    for(unsigned int v = 0; v < 16; v++)
+    {
+        registers[v][lane] = snapshot.registers[v];
+        stack[v][lane] = snapshot.stack[v];
+    }
+
+    program_counter[lane] = snapshot.program_counter;
+    index_register[lane] = snapshot.index_register;
+    stack_pointer[lane] = snapshot.stack_pointer;
+    delay_timer[lane] = snapshot.delay_timer;
+    sound_timer[lane] = snapshot.sound_timer;
+    keypad[lane] = snapshot.keypad;
+    key_wait[lane] = snapshot.key_wait;
+    key_wait_register[lane] = snapshot.key_wait_register;
+    fault[lane] = snapshot.fault;
+    rng_state[lane] = snapshot.rng_state;
+    dirty_rows[lane] = snapshot.dirty_rows;
+
+    timer_phase = snapshot.timer_phase;
+    cycle_count = snapshot.cycle_count;
+
+    loaded |= 1u << lane;
+    if(lane >= lane_count) {
+        lane_count = lane + 1;
+    }
+    return true;
+}
+
+void Chip8Batch::Store(std::size_t lane, Chip8& machine) const
+{
+    Chip8::Snapshot snapshot;
+
+    std::memcpy(snapshot.memory, memory[lane], MEMORY_SIZE);
+    std::memcpy(snapshot.screen, screen[lane], sizeof(snapshot.screen));
+
+    for(unsigned int v = 0; v < 16; v++)
+    {
+        snapshot.registers[v] = registers[v][lane];
+        snapshot.stack[v] = stack[v][lane];
+    }
+
+    snapshot.program_counter = program_counter[lane];
+    snapshot.index_register = index_register[lane];
+    snapshot.stack_pointer = stack_pointer[lane];
+    snapshot.delay_timer = delay_timer[lane];
+    snapshot.sound_timer = sound_timer[lane];
+    snapshot.keypad = keypad[lane];
+    snapshot.key_wait = key_wait[lane];
+    snapshot.key_wait_register = key_wait_register[lane];
+    snapshot.fault = fault[lane];
+    snapshot.timer_phase = timer_phase;
+    snapshot.cycle_count = cycle_count;
+    snapshot.rng_state = rng_state[lane];
+    snapshot.dirty_rows = dirty_rows[lane];
+
+    machine.Restore(snapshot);
+}
+
+void Chip8Batch::SetKeys(std::size_t lane, uint16_t keys)
+{
+    uint16_t pressed = keys & ~keypad[lane];
+    keypad[lane] = keys;
+
+    if(key_wait[lane] && pressed != 0)
+    {
+        //The lowest newly pressed key completes Fx0A
+        uint8_t key = 0;
+        while(!(pressed & (1u << key))) {
+            key++;
+        }
+
+        registers[key_wait_register[lane]][lane] = key;
+        key_wait[lane] = false;
+        key_wait_register[lane] = 0;
+        program_counter[lane] += 2;
+    }
+}
+
+uint64_t Chip8Batch::CyclesUntilTimerTick() const
+{
+    return (clock_rate - timer_phase + TIMER_RATE - 1) / TIMER_RATE;
+}
+
+uint64_t Chip8Batch::RunUntilFrame()
+{
+    uint64_t cycles = CyclesUntilTimerTick();
+    RunFor(cycles);
+    return cycles;
+}
+
+void Chip8Batch::RunFor(uint64_t cycles)
+{
+    while(cycles > 0)
+    {
+        uint64_t segment = CyclesUntilTimerTick();
+        if(segment > cycles) {
+            segment = cycles;
+        }
+
+        //A lane blocked in Fx0A only lets time pass, as on Chip8
+        uint32_t runnable = loaded;
+        for(std::size_t lane = 0; lane < lane_count; lane++) {
+            if(key_wait[lane]) {
+                runnable &= ~(1u << lane);
+            }
+        }
+
+        for(uint64_t i = 0; i < segment && runnable != 0; i++) {
+            runnable = step(runnable);
+        }
+
+        advance_clock(segment);
+        cycles -= segment;
+    }
+}
+
+void Chip8Batch::advance_clock(uint64_t cycles)
+{
+    cycle_count += cycles;
+
+    uint64_t phase = timer_phase + cycles * TIMER_RATE;
+    while(phase >= clock_rate)
+    {
+        phase -= clock_rate;
+
+        for(std::size_t lane = 0; lane < LANES; lane++)
+        {
+            delay_timer[lane] -= delay_timer[lane] > 0;
+            sound_timer[lane] -= sound_timer[lane] > 0;
+        }
+    }
+    timer_phase = static_cast<uint32_t>(phase);
+}
+
+uint32_t Chip8Batch::lanes_at(uint16_t address) const
+{
+#ifdef CHIP8_BATCH_AVX2
+    if(vector_path) {
+        return lanes_equal(program_counter, address);
+    }
+#endif
+    uint32_t lanes = 0;
+    for(std::size_t lane = 0; lane < LANES; lane++) {
+        lanes |= static_cast<uint32_t>(program_counter[lane] == address) << lane;
+    }
+    return lanes;
+}
+
+uint32_t Chip8Batch::step(uint32_t runnable)
+{
+    //Lanes are grouped by pc; each group runs as one vector operation when
+    //its lanes agree on the opcode and it has a vector form
+    uint32_t pending = runnable;
+    while(pending != 0)
+    {
+        unsigned int first = lowest_lane(pending);
+        uint16_t address = program_counter[first];
+        uint32_t group = lanes_at(address) & pending;
+        pending &= ~group;
+
+        unsigned int size = lane_total(group);
+        lane_instructions += size;
+
+        uint16_t high = address & ADDRESS_MASK;
+        uint16_t low = (address + 1) & ADDRESS_MASK;
+        if(size > 1 && vector_path && !diverged[high] && !diverged[low])
+        {
+            uint16_t opcode = static_cast<uint16_t>(memory[first][high] << 8u | memory[first][low]);
+            if(step_vector(address, opcode, group))
+            {
+                vector_instructions += size;
+                continue;
+            }
+        }
+
+        for(uint32_t lanes = group; lanes != 0; lanes &= lanes - 1)
+        {
+            unsigned int lane = lowest_lane(lanes);
+            if(step_lane(lane)) {
+                runnable &= ~(1u << lane);
+            }
+        }
+    }
+    return runnable;
+}
+
+#ifdef CHIP8_BATCH_AVX2
+__attribute__((target("avx2")))
+#endif
+bool Chip8Batch::step_vector(uint16_t address, uint16_t opcode, uint32_t group)
+{
+#ifdef CHIP8_BATCH_AVX2
+    unsigned int x = (opcode >> 8u) & 0xFu;
+    unsigned int y = (opcode >> 4u) & 0xFu;
+    uint8_t kk = opcode & 0xFFu;
+    uint16_t nnn = opcode & 0x0FFFu;
+
+    __m256i mask = byte_mask(group);
+    __m256i one = _mm256_set1_epi8(1);
+
+    //Results are written before VF, as the handlers do, so x = F behaves the same
+    switch(opcode >> 12u)
+    {
+        case 0x1:
+            set_pc(program_counter, group, nnn);
+            return true;
+
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9:
+        {
+            __m256i operand = (opcode >> 12u) == 0x3 || (opcode >> 12u) == 0x4
+                ? _mm256_set1_epi8(static_cast<char>(kk)) : load(registers[y]);
+            __m256i equal = _mm256_cmpeq_epi8(load(registers[x]), operand);
+            if((opcode >> 12u) == 0x4 || (opcode >> 12u) == 0x9) {
+                equal = _mm256_xor_si256(equal, _mm256_set1_epi8(-1));
+            }
+            skip_if(program_counter, group, address, equal);
+            return true;
+        }
+
+        case 0x6:
+            blend(registers[x], _mm256_set1_epi8(static_cast<char>(kk)), mask);
+            break;
+
+        case 0x7:
+            blend(registers[x], _mm256_add_epi8(load(registers[x]), _mm256_set1_epi8(static_cast<char>(kk))), mask);
+            break;
+
+        case 0x8:
+        {
+            __m256i vx = load(registers[x]);
+            __m256i vy = load(registers[y]);
+            __m256i source = policy.shiftFromVy ? vy : vx;
+
+            switch(opcode & 0xFu)
+            {
+                case 0x0:
+                    blend(registers[x], vy, mask);
+                    break;
+                case 0x1:
+                case 0x2:
+                case 0x3:
+                {
+                    unsigned int op = opcode & 0xFu;
+                    __m256i result = op == 0x1 ? _mm256_or_si256(vx, vy)
+                                   : op == 0x2 ? _mm256_and_si256(vx, vy) : _mm256_xor_si256(vx, vy);
+                    blend(registers[x], result, mask);
+                    if(policy.logicResetsVf) {
+                        blend(registers[0xF], _mm256_setzero_si256(), mask);
+                    }
+                    break;
+                }
+                case 0x4:
+                {
+                    //Saturating and wrapping sums differ exactly when it carries
+                    __m256i sum = _mm256_add_epi8(vx, vy);
+                    __m256i carry = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_adds_epu8(vx, vy), sum), one);
+                    blend(registers[x], sum, mask);
+                    blend(registers[0xF], carry, mask);
+                    break;
+                }
+                case 0x5:
+                {
+                    __m256i flag = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(vx, vy), vx), one);
+                    blend(registers[x], _mm256_sub_epi8(vx, vy), mask);
+                    blend(registers[0xF], flag, mask);
+                    break;
+                }
+                case 0x7:
+                {
+                    __m256i flag = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(vx, vy), vy), one);
+                    blend(registers[x], _mm256_sub_epi8(vy, vx), mask);
+                    blend(registers[0xF], flag, mask);
+                    break;
+                }
+                case 0x6:
+                {
+                    __m256i flag = _mm256_and_si256(source, one);
+                    blend(registers[x], _mm256_and_si256(_mm256_srli_epi16(source, 1), _mm256_set1_epi8(0x7F)), mask);
+                    blend(registers[0xF], flag, mask);
+                    break;
+                }
+                case 0xE:
+                {
+                    __m256i flag = _mm256_and_si256(_mm256_srli_epi16(source, 7), one);
+                    blend(registers[x], _mm256_add_epi8(source, source), mask);
+                    blend(registers[0xF], flag, mask);
+                    break;
+                }
+                default:
+                    //OP_NULL
+                    break;
+            }
+            break;
+        }
+
+        case 0xA:
+        {
+            __m256i value = _mm256_set1_epi16(static_cast<short>(nnn));
+            blend_words(index_register, value, value, group);
+            break;
+        }
+
+        case 0xF:
+        {
+            __m256i vx = load(registers[x]);
+            __m256i low = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(vx));
+            __m256i high = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(vx, 1));
+
+            if(kk == 0x07) {
+                blend(registers[x], load(delay_timer), mask);
+            }
+            else if(kk == 0x15) {
+                blend(delay_timer, vx, mask);
+            }
+            else if(kk == 0x18) {
+                blend(sound_timer, vx, mask);
+            }
+            else if(kk == 0x1E)
+            {
+                blend_words(index_register, _mm256_add_epi16(load(index_register), low),
+                            _mm256_add_epi16(load(index_register + 16), high), group);
+            }
+            else if(kk == 0x29)
+            {
+                __m256i five = _mm256_set1_epi16(5);
+                __m256i font = _mm256_set1_epi16(static_cast<short>(FONTSET_START_ADDRESS));
+                blend_words(index_register, _mm256_add_epi16(font, _mm256_mullo_epi16(low, five)),
+                            _mm256_add_epi16(font, _mm256_mullo_epi16(high, five)), group);
+            }
+            else {
+                return false;
+            }
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    set_pc(program_counter, group, static_cast<uint16_t>(address + 2));
+    return true;
+#else
+    (void)address;
+    (void)opcode;
+    (void)group;
+    return false;
+#endif
+}
+
+void Chip8Batch::write_memory(std::size_t lane, uint16_t address, uint8_t value)
+{
+    address &= ADDRESS_MASK;
+    memory[lane][address] = value;
+    diverged[address] = 1;
+}
+
+uint8_t Chip8Batch::random_byte(std::size_t lane)
+{
+    uint64_t& state = rng_state[lane];
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<uint8_t>(state >> 56);
+}
+
+bool Chip8Batch::step_lane(std::size_t lane)
+{
+    uint8_t* mem = memory[lane];
+    uint16_t& pc = program_counter[lane];
+    uint16_t& index = index_register[lane];
+    uint8_t& sp = stack_pointer[lane];
+
+    uint16_t address = pc & ADDRESS_MASK;
+    uint16_t opcode = static_cast<uint16_t>(mem[address] << 8u | mem[(address + 1) & ADDRESS_MASK]);
+    pc += 2;
+
+    unsigned int x = (opcode >> 8u) & 0xFu;
+    unsigned int y = (opcode >> 4u) & 0xFu;
+    uint8_t kk = opcode & 0xFFu;
+    uint16_t nnn = opcode & 0x0FFFu;
+    unsigned int n = opcode & 0xFu;
+
+    uint8_t& Vx = registers[x][lane];
+    uint8_t& Vy = registers[y][lane];
+    uint8_t& VF = registers[0xF][lane];
+
+    switch(opcode >> 12u)
+    {
+        case 0x0:
+            if(n == 0x0)
+            {
+                std::memset(screen[lane], 0, sizeof(screen[lane]));
+                dirty_rows[lane] = 0xFFFFFFFFu;
+            }
+            else if(n == 0xE)
+            {
+                if(sp == 0)
+                {
+                    pc -= 2;
+                    fault[lane] = Fault::StackUnderflow;
+                    break;
+                }
+                sp--;
+                pc = stack[sp][lane];
+            }
+            break;
+
+        case 0x1:
+            pc = nnn;
+            break;
+
+        case 0x2:
+            if(sp >= std::size(stack))
+            {
+                pc -= 2;
+                fault[lane] = Fault::StackOverflow;
+                break;
+            }
+            stack[sp][lane] = pc;
+            sp++;
+            pc = nnn;
+            break;
+
+        case 0x3:
+            pc += Vx == kk ? 2 : 0;
+            break;
+
+        case 0x4:
+            pc += Vx != kk ? 2 : 0;
+            break;
+
+        case 0x5:
+            pc += Vx == Vy ? 2 : 0;
+            break;
+
+        case 0x6:
+            Vx = kk;
+            break;
+
+        case 0x7:
+            Vx = static_cast<uint8_t>(Vx + kk);
+            break;
+
+        case 0x8:
+        {
+            uint8_t source = policy.shiftFromVy ? Vy : Vx;
+            uint8_t flag;
+
+            switch(n)
+            {
+                case 0x0:
+                    Vx = Vy;
+                    break;
+                case 0x1:
+                case 0x2:
+                case 0x3:
+                    Vx = n == 0x1 ? Vx | Vy : n == 0x2 ? Vx & Vy : Vx ^ Vy;
+                    if(policy.logicResetsVf) {
+                        VF = 0;
+                    }
+                    break;
+                case 0x4:
+                    flag = Vx + Vy > 0xFF ? 1 : 0;
+                    Vx = static_cast<uint8_t>(Vx + Vy);
+                    VF = flag;
+                    break;
+                case 0x5:
+                    flag = Vx >= Vy ? 1 : 0;
+                    Vx = static_cast<uint8_t>(Vx - Vy);
+                    VF = flag;
+                    break;
+                case 0x6:
+                    Vx = source >> 1u;
+                    VF = source & 0x1u;
+                    break;
+                case 0x7:
+                    flag = Vy >= Vx ? 1 : 0;
+                    Vx = static_cast<uint8_t>(Vy - Vx);
+                    VF = flag;
+                    break;
+                case 0xE:
+                    Vx = static_cast<uint8_t>(source << 1u);
+                    VF = source >> 7u;
+                    break;
+            }
+            break;
+        }
+
+        case 0x9:
+            pc += Vx != Vy ? 2 : 0;
+            break;
+
+        case 0xA:
+            index = nnn;
+            break;
+
+        case 0xB:
+            pc = nnn + registers[policy.jumpUsesVx ? x : 0][lane];
+            break;
+
+        case 0xC:
+            Vx = random_byte(lane) & kk;
+            break;
+
+        case 0xD:
+        {
+            uint8_t sprite[15];
+            for(unsigned int row = 0; row < n; row++) {
+                sprite[row] = mem[(index + row) & ADDRESS_MASK];
+            }
+            VF = DrawSprite(screen[lane], sprite, n, Vx % VIDEO_WIDTH, Vy % VIDEO_HEIGHT,
+                            policy.wrapSprites, dirty_rows[lane]) ? 1 : 0;
+            break;
+        }
+
+        case 0xE:
+            if(n == 0xE) {
+                pc += keypad[lane] & (1u << (Vx & 0xFu)) ? 2 : 0;
+            }
+            else if(n == 0x1) {
+                pc += keypad[lane] & (1u << (Vx & 0xFu)) ? 0 : 2;
+            }
+            break;
+
+        case 0xF:
+            switch(kk)
+            {
+                case 0x07:
+                    Vx = delay_timer[lane];
+                    break;
+                case 0x0A:
+                    key_wait[lane] = true;
+                    key_wait_register[lane] = static_cast<uint8_t>(x);
+                    pc -= 2;
+                    return true;
+                case 0x15:
+                    delay_timer[lane] = Vx;
+                    break;
+                case 0x18:
+                    sound_timer[lane] = Vx;
+                    break;
+                case 0x1E:
+                    index += Vx;
+                    break;
+                case 0x29:
+                    index = FONTSET_START_ADDRESS + 5 * Vx;
+                    break;
+                case 0x33:
+                {
+                    uint8_t value = Vx;
+                    write_memory(lane, index + 2, value % 10);
+                    value /= 10;
+                    write_memory(lane, index + 1, value % 10);
+                    value /= 10;
+                    write_memory(lane, index, value % 10);
+                    break;
+                }
+                case 0x55:
+                case 0x65:
+                    for(unsigned int i = 0; i <= x; i++)
+                    {
+                        if(kk == 0x55) {
+                            write_memory(lane, index + i, registers[i][lane]);
+                        }
+                        else {
+                            registers[i][lane] = mem[(index + i) & ADDRESS_MASK];
+                        }
+                    }
+                    if(policy.loadStoreIndex == IndexQuirk::AddX) {
+                        index += x;
+                    }
+                    else if(policy.loadStoreIndex == IndexQuirk::AddXPlusOne) {
+                        index += x + 1;
+                    }
+                    break;
+            }
+            break;
+    }
+
+    return false;
+}
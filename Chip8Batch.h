@@ -0,0 +1,136 @@
+#pragma once
+#include "Chip8.h"
+#include <cstddef>
+#include <cstdint>
+
+//Up to LANES machines with the same ROM, quirks and clock rate, stepped in
+//lockstep. State is kept as structure-of-arrays, one row of LANES entries
+//per register, so lanes sitting on the same instruction run it as one AVX2
+//operation. Lanes on different instructions, and instructions without a
+//vector form, run one lane at a time on a scalar interpreter. Each lane
+//ends in exactly the state a Chip8 with the same input would, except that
+//beeper edges are not logged. Holds LANES copies of memory, so it belongs
+//on the heap.
+class Chip8Batch {
+    public:
+        static const std::size_t LANES = 32;
+
+        explicit Chip8Batch(QuirkProfile quirks = QuirkProfile::CosmacVip, bool wrapSprites = false,
+                            uint32_t clockRate = DEFAULT_CLOCK_RATE);
+
+        //True when this build and CPU run the AVX2 kernels
+        static bool HasVectorPath();
+
+        //Copies machine into lane. The machine has to have the batch's
+        //quirks, sprite wrapping and clock rate, and be at the same cycle
+        //count and timer phase as the lanes loaded before it; returns false
+        //otherwise or when lane is out of range.
+        bool Load(std::size_t lane, Chip8 const& machine);
+
+        //Writes a lane into a machine that has the lane's ROM loaded
+        void Store(std::size_t lane, Chip8& machine) const;
+
+        //Lanes 0 to GetLaneCount() - 1 have been loaded
+        std::size_t GetLaneCount() const { return lane_count; }
+
+        //Same as Chip8::SetKeys for one lane
+        void SetKeys(std::size_t lane, uint16_t keys);
+
+        //Same as Chip8::RunFor on every lane
+        void RunFor(uint64_t cycles);
+
+        uint64_t RunUntilFrame();
+
+        uint64_t CyclesUntilTimerTick() const;
+
+        uint64_t GetCycleCount() const { return cycle_count; }
+
+        Fault GetFault(std::size_t lane) const { return fault[lane]; }
+
+        bool IsWaitingForKey(std::size_t lane) const { return key_wait[lane]; }
+
+        uint64_t const* GetScreen(std::size_t lane) const { return screen[lane]; }
+
+        uint64_t GetScreenHash(std::size_t lane) const { return Chip8::HashScreen(screen[lane]); }
+
+        //Instructions run across all lanes, and how many of them ran as part
+        //of a vector operation
+        uint64_t GetLaneInstructions() const { return lane_instructions; }
+
+        uint64_t GetVectorInstructions() const { return vector_instructions; }
+
+    private:
+        //Quirks the kernels test at run time
+        struct Policy {
+            bool shiftFromVy;
+            bool logicResetsVf;
+            IndexQuirk loadStoreIndex;
+            bool jumpUsesVx;
+            bool wrapSprites;
+        };
+
+        template<typename Quirks>
+        static Policy make_policy(bool wrapSprites);
+
+        QuirkProfile quirks;
+        Policy policy {};
+        uint32_t clock_rate;
+
+        //HasVectorPath(), looked up once
+        bool vector_path;
+        std::size_t lane_count {};
+
+        //Lanes that have been loaded, bit n for lane n
+        uint32_t loaded {};
+
+        //Shared by every lane
+        uint32_t timer_phase {};
+        uint64_t cycle_count {};
+
+        alignas(32) uint8_t registers[16][LANES] {};
+        alignas(32) uint16_t program_counter[LANES] {};
+        alignas(32) uint16_t index_register[LANES] {};
+        alignas(32) uint16_t stack[16][LANES] {};
+        alignas(32) uint8_t stack_pointer[LANES] {};
+        alignas(32) uint8_t delay_timer[LANES] {};
+        alignas(32) uint8_t sound_timer[LANES] {};
+        uint16_t keypad[LANES] {};
+        bool key_wait[LANES] {};
+        uint8_t key_wait_register[LANES] {};
+        Fault fault[LANES] {};
+        uint64_t rng_state[LANES] {};
+        uint32_t dirty_rows[LANES] {};
+
+        //1 bit per pixel per lane, laid out like Chip8::screen
+        uint64_t screen[LANES][VIDEO_HEIGHT] {};
+
+        uint8_t memory[LANES][MEMORY_SIZE] {};
+
+        //1 where lanes may hold different bytes: stored to since loading, or
+        //different between the loaded machines. Elsewhere every lane fetches
+        //the same opcode.
+        uint8_t diverged[MEMORY_SIZE] {};
+
+        uint64_t lane_instructions {};
+        uint64_t vector_instructions {};
+
+        //Lanes whose pc equals address
+        uint32_t lanes_at(uint16_t address) const;
+
+        //One instruction on every lane in runnable; returns the lanes still
+        //runnable, without those that started waiting for a key
+        uint32_t step(uint32_t runnable);
+
+        //Runs opcode on every lane of group, all of which are at address.
+        //False if the opcode has no vector form.
+        bool step_vector(uint16_t address, uint16_t opcode, uint32_t group);
+
+        //Runs one instruction on one lane; true if it started a key wait
+        bool step_lane(std::size_t lane);
+
+        void write_memory(std::size_t lane, uint16_t address, uint8_t value);
+
+        uint8_t random_byte(std::size_t lane);
+
+        void advance_clock(uint64_t cycles);
+};
@@ -0,0 +1,348 @@
+#include "Chip8.h"
+#include <cstring>
+#include <iterator>
+
+/*
+Snapshot layout, all integers little-endian:
+
+  "C8SV"  version:u8  rom_hash:u64
+  registers[16]  stack[16]:u16  pc:u16  index:u16  sp:u8  delay:u8  sound:u8
+  clock_rate:u32  timer_phase:u32  cycle_count:u64  keypad:u16  wrap_sprites:u8
+  quirks:u8  fault:u8  key_wait:u8 (register + 1, 0 when not waiting)
+  rng_state:u64
+  row_mask:u32  then one u64 per set bit, lowest row first
+  memory runs against the ROM image: offset:u16 length:u8 bytes[length],
+  terminated by offset 0xFFFF
+*/
+
+static const uint8_t STATE_MAGIC[4] = {'C', '8', 'S', 'V'};
+static const uint8_t STATE_VERSION = 5;
+static const uint16_t END_OF_RUNS = 0xFFFF;
+
+//Bounds-checked little-endian writer over a caller-provided buffer
+struct StateWriter {
+    uint8_t* out;
+    std::size_t capacity;
+    std::size_t size;
+    bool overflow;
+
+    void put_bytes(void const* data, std::size_t count)
+    {
+        if(overflow || capacity - size < count) {
+            overflow = true;
+            return;
+        }
+        std::memcpy(out + size, data, count);
+        size += count;
+    }
+
+    void put(uint64_t value, unsigned int bytes)
+    {
+        uint8_t encoded[8];
+        for(unsigned int i = 0; i < bytes; i++) {
+            encoded[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+        put_bytes(encoded, bytes);
+    }
+};
+
+struct StateReader {
+    uint8_t const* in;
+    std::size_t size;
+    std::size_t position;
+    bool underflow;
+
+    bool get_bytes(void* data, std::size_t count)
+    {
+        if(underflow || size - position < count) {
+            underflow = true;
+            return false;
+        }
+        std::memcpy(data, in + position, count);
+        position += count;
+        return true;
+    }
+
+    uint64_t get(unsigned int bytes)
+    {
+        uint8_t encoded[8] {};
+        get_bytes(encoded, bytes);
+
+        uint64_t value = 0;
+        for(unsigned int i = 0; i < bytes; i++) {
+            value |= static_cast<uint64_t>(encoded[i]) << (8 * i);
+        }
+        return value;
+    }
+};
+
+std::size_t Chip8::SaveState(uint8_t* buffer, std::size_t capacity) const
+{
+    StateWriter writer {buffer, capacity, 0, false};
+
+    writer.put_bytes(STATE_MAGIC, sizeof(STATE_MAGIC));
+    writer.put(STATE_VERSION, 1);
+    writer.put(rom_hash, 8);
+
+    writer.put_bytes(registers, sizeof(registers));
+    for(uint16_t entry : stack) {
+        writer.put(entry, 2);
+    }
+    writer.put(program_counter, 2);
+    writer.put(index_register, 2);
+    writer.put(stack_pointer, 1);
+    writer.put(delay_timer, 1);
+    writer.put(sound_timer, 1);
+
+    writer.put(clock_rate, 4);
+    writer.put(timer_phase, 4);
+    writer.put(cycle_count, 8);
+
+    writer.put(keypad, 2);
+    writer.put(wrap_sprites, 1);
+    writer.put(static_cast<uint8_t>(quirks), 1);
+    writer.put(static_cast<uint8_t>(fault), 1);
+    writer.put(key_wait ? key_wait_register + 1 : 0, 1);
+
+    writer.put(rng_state, 8);
+
+    //Only rows with lit pixels are stored
+    uint32_t rowMask = 0;
+    for(unsigned int row = 0; row < VIDEO_HEIGHT; row++) {
+        rowMask |= (screen[row] != 0 ? 1u : 0u) << row;
+    }
+    writer.put(rowMask, 4);
+    for(unsigned int row = 0; row < VIDEO_HEIGHT; row++) {
+        if(screen[row] != 0) {
+            writer.put(screen[row], 8);
+        }
+    }
+
+    //Runs of bytes that differ from the ROM image; short equal gaps are
+    //folded into a run since a new run header costs three bytes
+    if(image != rom_image)
+    {
+        uint8_t const* base = rom_image->bytes;
+        unsigned int address = 0;
+
+        while(address < MEMORY_SIZE)
+        {
+            //Skip identical stretches a word at a time
+            uint64_t current, original;
+            if(address + sizeof(current) <= MEMORY_SIZE)
+            {
+                std::memcpy(&current, memory + address, sizeof(current));
+                std::memcpy(&original, base + address, sizeof(original));
+                if(current == original) {
+                    address += sizeof(current);
+                    continue;
+                }
+            }
+            if(memory[address] == base[address]) {
+                address++;
+                continue;
+            }
+
+            unsigned int start = address;
+            unsigned int end = address + 1;
+            while(end < MEMORY_SIZE && end - start < 255)
+            {
+                if(memory[end] != base[end]) {
+                    end++;
+                    continue;
+                }
+
+                unsigned int gap = end;
+                while(gap < MEMORY_SIZE && gap - end < 3 && memory[gap] == base[gap]) {
+                    gap++;
+                }
+                if(gap < MEMORY_SIZE && gap - end < 3 && gap - start < 255) {
+                    end = gap;
+                }
+                else {
+                    break;
+                }
+            }
+
+            writer.put(start, 2);
+            writer.put(end - start, 1);
+            writer.put_bytes(memory + start, end - start);
+            address = end;
+        }
+    }
+    writer.put(END_OF_RUNS, 2);
+
+    return writer.overflow ? 0 : writer.size;
+}
+
+bool Chip8::LoadState(uint8_t const* data, std::size_t size)
+{
+    StateReader reader {data, size, 0, false};
+
+    uint8_t magic[4];
+    if(!reader.get_bytes(magic, sizeof(magic)) || std::memcmp(magic, STATE_MAGIC, sizeof(magic)) != 0) {
+        return false;
+    }
+    if(reader.get(1) != STATE_VERSION || reader.get(8) != rom_hash) {
+        return false;
+    }
+
+    //Decode into a scratch copy so a malformed snapshot leaves this machine untouched
+    Chip8 restored = *this;
+
+    reader.get_bytes(restored.registers, sizeof(restored.registers));
+    for(uint16_t& entry : restored.stack) {
+        entry = static_cast<uint16_t>(reader.get(2));
+    }
+    restored.program_counter = static_cast<uint16_t>(reader.get(2));
+    restored.index_register = static_cast<uint16_t>(reader.get(2));
+    restored.stack_pointer = static_cast<uint8_t>(reader.get(1));
+    restored.delay_timer = static_cast<uint8_t>(reader.get(1));
+    restored.sound_timer = static_cast<uint8_t>(reader.get(1));
+    if(restored.stack_pointer > std::size(restored.stack)) {
+        return false;
+    }
+
+    restored.clock_rate = static_cast<uint32_t>(reader.get(4));
+    restored.timer_phase = static_cast<uint32_t>(reader.get(4));
+    restored.cycle_count = reader.get(8);
+    if(restored.clock_rate == 0 || restored.timer_phase >= restored.clock_rate) {
+        return false;
+    }
+
+    restored.keypad = static_cast<uint16_t>(reader.get(2));
+    restored.wrap_sprites = reader.get(1) != 0;
+
+    uint8_t profile = static_cast<uint8_t>(reader.get(1));
+    if(profile > static_cast<uint8_t>(QuirkProfile::SuperChip)) {
+        return false;
+    }
+    restored.quirks = static_cast<QuirkProfile>(profile);
+
+    uint8_t reason = static_cast<uint8_t>(reader.get(1));
+    if(reason > static_cast<uint8_t>(Fault::StackUnderflow)) {
+        return false;
+    }
+    restored.fault = static_cast<Fault>(reason);
+
+    uint8_t wait = static_cast<uint8_t>(reader.get(1));
+    if(wait > 16) {
+        return false;
+    }
+    restored.key_wait = wait != 0;
+    restored.key_wait_register = wait != 0 ? wait - 1 : 0;
+
+    restored.rng_state = reader.get(8);
+    if(restored.rng_state == 0) {
+        return false;
+    }
+
+    uint32_t rowMask = static_cast<uint32_t>(reader.get(4));
+    for(unsigned int row = 0; row < VIDEO_HEIGHT; row++) {
+        restored.screen[row] = (rowMask >> row) & 1u ? reader.get(8) : 0;
+    }
+
+    //Start from the ROM image and only take a private copy if there are runs
+    restored.image = std::const_pointer_cast<MemoryImage>(rom_image);
+    restored.memory = restored.image->bytes;
+
+    for(;;)
+    {
+        uint16_t start = static_cast<uint16_t>(reader.get(2));
+        if(reader.underflow) {
+            return false;
+        }
+        if(start == END_OF_RUNS) {
+            break;
+        }
+
+        uint8_t length = static_cast<uint8_t>(reader.get(1));
+        if(start + length > MEMORY_SIZE) {
+            return false;
+        }
+
+        restored.own_memory();
+        if(!reader.get_bytes(restored.memory + start, length)) {
+            return false;
+        }
+    }
+
+    if(reader.underflow) {
+        return false;
+    }
+
+    restored.rehash_memory();
+    *this = restored;
+
+    select_quirks();
+    dirty_rows = 0xFFFFFFFFu;
+    reset_beeper();
+    return true;
+}
+
+void Chip8::Capture(Snapshot& snapshot) const
+{
+    std::memcpy(snapshot.memory, memory, MEMORY_SIZE);
+    std::memcpy(snapshot.registers, registers, sizeof(registers));
+    std::memcpy(snapshot.stack, stack, sizeof(stack));
+    std::memcpy(snapshot.screen, screen, sizeof(screen));
+
+    snapshot.program_counter = program_counter;
+    snapshot.index_register = index_register;
+    snapshot.stack_pointer = stack_pointer;
+    snapshot.delay_timer = delay_timer;
+    snapshot.sound_timer = sound_timer;
+    snapshot.keypad = keypad;
+    snapshot.key_wait = key_wait;
+    snapshot.key_wait_register = key_wait_register;
+    snapshot.fault = fault;
+    snapshot.timer_phase = timer_phase;
+    snapshot.cycle_count = cycle_count;
+    snapshot.rng_state = rng_state;
+    snapshot.dirty_rows = dirty_rows;
+}
+
+void Chip8::Restore(Snapshot const& snapshot)
+{
+    //Compare a word at a time and go through write_memory for the bytes
+    //that changed, which keeps the decode caches coherent
+    for(unsigned int address = 0; address < MEMORY_SIZE; address += 8)
+    {
+        if(std::memcmp(memory + address, snapshot.memory + address, 8) == 0) {
+            continue;
+        }
+        for(unsigned int i = address; i < address + 8; i++) {
+            if(memory[i] != snapshot.memory[i]) {
+                write_memory(static_cast<uint16_t>(i), snapshot.memory[i]);
+            }
+        }
+    }
+
+    //Rows that differ from what is on screen now have to be presented again
+    uint32_t changed = 0;
+    for(unsigned int row = 0; row < VIDEO_HEIGHT; row++) {
+        if(screen[row] != snapshot.screen[row]) {
+            changed |= 1u << row;
+        }
+    }
+
+    std::memcpy(registers, snapshot.registers, sizeof(registers));
+    std::memcpy(stack, snapshot.stack, sizeof(stack));
+    std::memcpy(screen, snapshot.screen, sizeof(screen));
+
+    program_counter = snapshot.program_counter;
+    index_register = snapshot.index_register;
+    stack_pointer = snapshot.stack_pointer;
+    delay_timer = snapshot.delay_timer;
+    sound_timer = snapshot.sound_timer;
+    keypad = snapshot.keypad;
+    key_wait = snapshot.key_wait;
+    key_wait_register = snapshot.key_wait_register;
+    fault = snapshot.fault;
+    timer_phase = snapshot.timer_phase;
+    cycle_count = snapshot.cycle_count;
+    rng_state = snapshot.rng_state;
+    dirty_rows = snapshot.dirty_rows | dirty_rows | changed;
+    reset_beeper();
+    check_compiled();
+}
@@ -0,0 +1,38 @@
+#include "Compiled.h"
+
+CompiledRomRegistry& CompiledRomRegistry::Global()
+{
+    static CompiledRomRegistry registry;
+    return registry;
+}
+
+bool CompiledRomRegistry::Add(CompiledRom const* rom)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    roms[rom->rom_hash].push_back(rom);
+    return true;
+}
+
+CompiledRom const* CompiledRomRegistry::Find(uint64_t romHash, QuirkProfile quirks, bool wrapSprites)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto entry = roms.find(romHash);
+    if(entry == roms.end()) {
+        return nullptr;
+    }
+    for(CompiledRom const* rom : entry->second)
+    {
+        if(rom->quirks == quirks && rom->wrap_sprites == wrapSprites) {
+            return rom;
+        }
+    }
+    return nullptr;
+}
+
+void CompiledRuntime::Execute(Chip8& chip8, uint16_t opcode)
+{
+    Chip8::Instruction op = chip8.decode(opcode);
+    op.handler = chip8.resolve(opcode);
+    (chip8.*op.handler)(op);
+}
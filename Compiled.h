@@ -0,0 +1,70 @@
+#pragma once
+#include "Chip8.h"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+//A ROM translated to C++ by the recompile tool. The generated file defines
+//one of these and adds it to CompiledRomRegistry::Global() when it is
+//linked in; Engine::Compiled then runs it for machines with the same ROM,
+//quirk profile and sprite wrapping.
+struct CompiledRom {
+    uint64_t rom_hash;
+    QuirkProfile quirks;
+    bool wrap_sprites;
+
+    //Memory as the tool read it, and 1 for every byte of an instruction it
+    //translated. A store that changes such a byte makes the translation
+    //stale and the machine falls back to the interpreter.
+    uint8_t const* image;
+    uint8_t const* code_map;
+
+    //Runs translated code from the current pc for at most budget
+    //instructions and returns how many ran. Stops early, possibly at 0, on
+    //an instruction it leaves to the interpreter or a pc it has no code for.
+    uint64_t (*run)(Chip8& chip8, uint64_t budget);
+};
+
+class CompiledRomRegistry {
+    public:
+        static CompiledRomRegistry& Global();
+
+        //Returns true so a generated file can register from an initializer
+        bool Add(CompiledRom const* rom);
+
+        CompiledRom const* Find(uint64_t romHash, QuirkProfile quirks, bool wrapSprites);
+
+    private:
+        std::mutex lock;
+        std::map<uint64_t, std::vector<CompiledRom const*>> roms;
+};
+
+//The machine internals generated code works on. Only code emitted by the
+//recompile tool should use this.
+class CompiledRuntime {
+    public:
+        static uint8_t* Registers(Chip8& chip8) { return chip8.registers; }
+
+        static uint16_t& Index(Chip8& chip8) { return chip8.index_register; }
+
+        static uint16_t& ProgramCounter(Chip8& chip8) { return chip8.program_counter; }
+
+        static uint16_t* Stack(Chip8& chip8) { return chip8.stack; }
+
+        static uint8_t& StackPointer(Chip8& chip8) { return chip8.stack_pointer; }
+
+        static uint8_t& DelayTimer(Chip8& chip8) { return chip8.delay_timer; }
+
+        static uint16_t Keys(Chip8 const& chip8) { return chip8.keypad; }
+
+        static uint8_t Random(Chip8& chip8) { return chip8.random_byte(); }
+
+        //True once a store changed translated code
+        static bool Stale(Chip8 const& chip8) { return chip8.compiled_stale; }
+
+        //Runs one instruction through the interpreter's handler, for the
+        //opcodes generated code does not inline. The registers it touches
+        //must be written back to the machine first.
+        static void Execute(Chip8& chip8, uint16_t opcode);
+};
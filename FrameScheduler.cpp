@@ -0,0 +1,67 @@
+#include "FrameScheduler.h"
+#include <cmath>
+#include <thread>
+
+FrameScheduler::FrameScheduler(double frameRate, bool vsync)
+    : frame_period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frameRate))),
+      vsync(vsync),
+      start(Clock::now()),
+      deadline(start + frame_period),
+      last_frame(start),
+      cpu_start(std::clock())
+{}
+
+void FrameScheduler::WaitForNextFrame()
+{
+    //OS sleeps overshoot by up to a scheduler tick, so wake a little early
+    const auto SPIN_MARGIN = std::chrono::milliseconds(1);
+
+    if(!vsync)
+    {
+        Clock::time_point now = Clock::now();
+
+        if(now < deadline)
+        {
+            if(deadline - now > SPIN_MARGIN)
+            {
+                std::this_thread::sleep_until(deadline - SPIN_MARGIN);
+            }
+            while(Clock::now() < deadline)
+            {
+                std::this_thread::yield();
+            }
+            deadline += frame_period;
+        }
+        else
+        {
+            //Fell behind by a whole frame or more; resync instead of bursting
+            late_frames++;
+            deadline = now + frame_period;
+        }
+    }
+
+    Clock::time_point now = Clock::now();
+    double interval = std::chrono::duration<double, std::milli>(now - last_frame).count();
+    last_frame = now;
+
+    frames++;
+    interval_sum += interval;
+    interval_square_sum += interval * interval;
+    if(interval > interval_max) {
+        interval_max = interval;
+    }
+}
+
+void FrameScheduler::Report(std::ostream& out) const
+{
+    double wall = std::chrono::duration<double>(Clock::now() - start).count();
+    double cpu = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+    double mean = frames > 0 ? interval_sum / frames : 0.0;
+    double variance = frames > 0 ? interval_square_sum / frames - mean * mean : 0.0;
+    double jitter = variance > 0.0 ? std::sqrt(variance) : 0.0;
+
+    out << frames << " frames, mean " << mean << " ms, jitter " << jitter
+        << " ms, worst " << interval_max << " ms, " << late_frames << " late\n";
+    out << "host cpu " << (wall > 0 ? 100.0 * cpu / wall : 0.0) << "% of one core\n";
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <ostream>
+
+//Paces the host loop at a fixed frame rate. Sleeps for most of the gap to
+//the next frame deadline and spins only for the last stretch, then tracks
+//frame-to-frame jitter and the share of a core the process used.
+class FrameScheduler {
+    public:
+        //When vsync is set the present call already blocks, so the
+        //scheduler only measures instead of sleeping
+        FrameScheduler(double frameRate, bool vsync);
+
+        void WaitForNextFrame();
+
+        void Report(std::ostream& out) const;
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        Clock::duration frame_period;
+        bool vsync;
+
+        Clock::time_point start;
+        Clock::time_point deadline;
+        Clock::time_point last_frame;
+        std::clock_t cpu_start;
+
+        uint64_t frames {};
+        uint64_t late_frames {};
+        double interval_sum {};
+        double interval_square_sum {};
+        double interval_max {};
+};
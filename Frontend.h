@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+//Everything the frame loop needs from the host: a video sink for RGBA8888
+//frames, an audio sink for the beeper and an input source for the keypad
+class Frontend
+{
+public:
+    virtual ~Frontend() = default;
+    //buffer always holds the whole frame; only the rows in dirtyRows changed
+    virtual void Update(void const* buffer, int pitch, uint32_t dirtyRows) = 0;
+    //Mono samples at AUDIO_SAMPLE_RATE from BeeperSynth. May be called from
+    //the emulation thread while the others run on the render thread, and
+    //must never block; samples that do not fit are dropped.
+    virtual void QueueAudio(float const* samples, std::size_t count) = 0;
+    //Updates the held-key mask (bit n for key n); returns true when asked to quit
+    virtual bool ProcessInput(uint16_t& keys) = 0;
+};
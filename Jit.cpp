@@ -0,0 +1,976 @@
+#include "Jit.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <mutex>
+
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(CHIP8_NO_JIT)
+#define CHIP8_JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*
+Register use inside translated code:
+
+  rbx  the Chip8, every field is addressed as [rbx + offset]
+  rbp  instructions left in the budget
+  r12  JitCode::entries, for the dispatch stub
+  r13  the budget on entry, so the exit stub can return what ran
+  rsi, rdi, r8-r11  up to six guest registers a block uses most
+  rax, rcx, rdx  scratch
+
+Every instruction takes one unit of the budget first and leaves on it when
+none is left, so RunFor still stops on the exact cycle of a timer tick.
+Exits to a known address store the pc and jump straight to that block, or
+to the exit stub until it is translated. Only 00EE, whose target is not
+known until it runs, goes through the dispatch stub instead; the keypad
+skips run their handler and then exit to one of their two fixed addresses
+by comparing the pc it left. Guest registers held in host registers
+are written back before every exit and helper call, since helpers run
+interpreter handlers on the machine itself, except on a jump back to the
+start of the same block, where they stay in host registers.
+
+The arena is never writable and executable at once: it is mapped read and
+write, and made read and execute again after the stubs and after each
+translation, including the patches to jumps waiting for it. That costs two
+mprotect calls per translated block, which only happen once a block is hot.
+*/
+
+#ifdef CHIP8_JIT_X86_64
+
+namespace {
+
+//The last address an instruction can start at without the pc leaving memory
+const unsigned int LAST_ADDRESS = MEMORY_SIZE - 4;
+
+//Times the engine has to arrive at an address before it is translated
+const uint8_t HOT_THRESHOLD = 8;
+
+const unsigned int MAX_BLOCK_LENGTH = 64;
+
+const std::size_t ARENA_SIZE = 1u << 20;
+
+//Upper bound on the code for one block, so a translation never runs out of
+//arena halfway
+const std::size_t MAX_BLOCK_BYTES = MAX_BLOCK_LENGTH * 256 + 256;
+
+//Switches the whole arena between writing code and running it
+bool set_writable(uint8_t* arena, bool writable)
+{
+    int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+    return mprotect(arena, ARENA_SIZE, protection) == 0;
+}
+
+std::mutex perf_lock;
+FILE* perf_map = nullptr;
+
+//Quirks that change inlined code; the rest run through interpreter handlers
+struct Policy {
+    bool shiftFromVy;
+    bool logicResetsVf;
+};
+
+template<typename Quirks>
+Policy make_policy()
+{
+    return Policy {Quirks::SHIFT_FROM_VY, Quirks::LOGIC_RESETS_VF};
+}
+
+Policy policy_for(QuirkProfile profile)
+{
+    switch(profile)
+    {
+        case QuirkProfile::Chip48: return make_policy<Chip48Quirks>();
+        case QuirkProfile::SuperChip: return make_policy<SuperChipQuirks>();
+        default: return make_policy<CosmacVipQuirks>();
+    }
+}
+
+enum Reg : uint8_t {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+//Guest register caches, in the order they are handed out
+const Reg CACHE_REGS[] = {RSI, RDI, R8, R9, R10, R11};
+
+//Low nibble of the jcc opcode
+enum Cond : uint8_t {
+    BELOW = 0x2,
+    ABOVE_EQUAL = 0x3,
+    EQUAL = 0x4,
+    NOT_EQUAL = 0x5,
+    ABOVE = 0x7
+};
+
+//Two-operand ALU ops: the opcode of "op r/m32, r32" and the /digit of
+//"op r/m32, imm32"
+struct AluOp {
+    uint8_t opcode;
+    uint8_t digit;
+};
+
+const AluOp ADD {0x01, 0};
+const AluOp OR {0x09, 1};
+const AluOp AND {0x21, 4};
+const AluOp SUB {0x29, 5};
+const AluOp XOR {0x31, 6};
+const AluOp CMP {0x39, 7};
+
+//Just the encodings translated code needs. Memory operands are always
+//[rbx + disp32]; register operands are 32-bit.
+class Assembler {
+    public:
+        Assembler(uint8_t* base, std::size_t at) : base(base), at(at) {}
+
+        std::size_t Here() const { return at; }
+
+        void Bytes(std::initializer_list<uint8_t> bytes)
+        {
+            for(uint8_t byte : bytes) {
+                base[at++] = byte;
+            }
+        }
+
+        void Int16(uint16_t value)
+        {
+            Bytes({uint8_t(value), uint8_t(value >> 8)});
+        }
+
+        void Int32(uint32_t value)
+        {
+            for(int shift = 0; shift < 32; shift += 8) {
+                base[at++] = uint8_t(value >> shift);
+            }
+        }
+
+        void Int64(uint64_t value)
+        {
+            Int32(uint32_t(value));
+            Int32(uint32_t(value >> 32));
+        }
+
+        //movzx dst, byte [rbx + disp]
+        void LoadByte(Reg dst, int32_t disp)
+        {
+            rex(dst >= R8, false, false);
+            Bytes({0x0F, 0xB6, field(dst)});
+            Int32(disp);
+        }
+
+        //mov byte [rbx + disp], src
+        void StoreByte(int32_t disp, Reg src)
+        {
+            rex(src >= R8, false, src >= RSP);
+            Bytes({0x88, field(src)});
+            Int32(disp);
+        }
+
+        //movzx dst, word [rbx + disp]
+        void LoadWord(Reg dst, int32_t disp)
+        {
+            rex(dst >= R8, false, false);
+            Bytes({0x0F, 0xB7, field(dst)});
+            Int32(disp);
+        }
+
+        //mov word [rbx + disp], src
+        void StoreWord(int32_t disp, Reg src)
+        {
+            Bytes({0x66});
+            rex(src >= R8, false, false);
+            Bytes({0x89, field(src)});
+            Int32(disp);
+        }
+
+        //mov word [rbx + disp], value
+        void StoreWord(int32_t disp, uint16_t value)
+        {
+            Bytes({0x66, 0xC7, field(RAX)});
+            Int32(disp);
+            Int16(value);
+        }
+
+        void Move(Reg dst, Reg src)
+        {
+            rex(src >= R8, dst >= R8, false);
+            Bytes({0x89, direct(src, dst)});
+        }
+
+        void Move(Reg dst, uint32_t value)
+        {
+            rex(false, dst >= R8, false);
+            Bytes({uint8_t(0xB8 + (dst & 7))});
+            Int32(value);
+        }
+
+        //movzx dst, low byte of src
+        void ZeroExtendByte(Reg dst, Reg src)
+        {
+            rex(dst >= R8, src >= R8, src >= RSP);
+            Bytes({0x0F, 0xB6, direct(dst, src)});
+        }
+
+        void Alu(AluOp op, Reg dst, Reg src)
+        {
+            rex(src >= R8, dst >= R8, false);
+            Bytes({op.opcode, direct(src, dst)});
+        }
+
+        void Alu(AluOp op, Reg dst, uint32_t value)
+        {
+            rex(false, dst >= R8, false);
+            Bytes({0x81, uint8_t(0xC0 | op.digit << 3 | (dst & 7))});
+            Int32(value);
+        }
+
+        void ShiftLeft(Reg dst, uint8_t count)
+        {
+            rex(false, dst >= R8, false);
+            Bytes({0xC1, uint8_t(0xE0 | (dst & 7)), count});
+        }
+
+        void ShiftRight(Reg dst, uint8_t count)
+        {
+            rex(false, dst >= R8, false);
+            Bytes({0xC1, uint8_t(0xE8 | (dst & 7)), count});
+        }
+
+        //setae on al, cl or dl
+        void SetAboveEqual(Reg dst)
+        {
+            Bytes({0x0F, 0x93, uint8_t(0xC0 | dst)});
+        }
+
+        //op rbp, value on the 64-bit budget
+        void Budget(AluOp op, uint32_t value)
+        {
+            Bytes({0x48, 0x81, uint8_t(0xC0 | op.digit << 3 | RBP)});
+            Int32(value);
+        }
+
+        //jmp or jcc with a rel32 to fill in later; returns where it goes
+        std::size_t Jump()
+        {
+            Bytes({0xE9});
+            return displacement();
+        }
+
+        std::size_t Jump(Cond cond)
+        {
+            Bytes({0x0F, uint8_t(0x80 | cond)});
+            return displacement();
+        }
+
+        void JumpTo(std::size_t target)
+        {
+            Patch(Jump(), target);
+        }
+
+        void JumpTo(Cond cond, std::size_t target)
+        {
+            Patch(Jump(cond), target);
+        }
+
+        //Points an earlier jump here
+        void Bind(std::size_t site)
+        {
+            Patch(site, at);
+        }
+
+        void Patch(std::size_t site, std::size_t target)
+        {
+            uint32_t relative = uint32_t(int32_t(target - (site + 4)));
+            for(int i = 0; i < 4; i++) {
+                base[site + i] = uint8_t(relative >> (8 * i));
+            }
+        }
+
+    private:
+        uint8_t* base;
+        std::size_t at;
+
+        //REX.R for the reg field, REX.B for r/m, and a bare REX when a byte
+        //operand is sil or dil rather than dh or bh
+        void rex(bool r, bool b, bool byteOperand)
+        {
+            if(r || b || byteOperand) {
+                Bytes({uint8_t(0x40 | (r ? 4 : 0) | (b ? 1 : 0))});
+            }
+        }
+
+        //ModRM for reg with [rbx + disp32]
+        static uint8_t field(Reg reg)
+        {
+            return uint8_t(0x80 | (reg & 7) << 3 | RBX);
+        }
+
+        //ModRM for reg with a register r/m
+        static uint8_t direct(Reg reg, Reg rm)
+        {
+            return uint8_t(0xC0 | (reg & 7) << 3 | (rm & 7));
+        }
+
+        std::size_t displacement()
+        {
+            std::size_t site = at;
+            Int32(0);
+            return site;
+        }
+};
+
+//Where the fields translated code touches sit inside a Chip8
+struct Layout {
+    int32_t registers;
+    int32_t index;
+    int32_t pc;
+    int32_t stack;
+    int32_t sp;
+    int32_t delay;
+    int32_t dirty;
+};
+
+void write_perf_symbol(uint8_t const* start, std::size_t size, char const* name)
+{
+    std::lock_guard<std::mutex> guard(perf_lock);
+    if(perf_map)
+    {
+        std::fprintf(perf_map, "%llx %zx %s\n", static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(start)),
+                     size, name);
+        std::fflush(perf_map);
+    }
+}
+
+}
+
+#endif
+
+void Chip8::JitDeleter::operator()(JitCode* code) const
+{
+    delete code;
+}
+
+bool JitCode::Supported()
+{
+#ifdef CHIP8_JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+void JitCode::EnablePerfMap()
+{
+#ifdef CHIP8_JIT_X86_64
+    std::lock_guard<std::mutex> guard(perf_lock);
+    if(!perf_map)
+    {
+        char path[64];
+        std::snprintf(path, sizeof(path), "/tmp/perf-%d.map", static_cast<int>(getpid()));
+        perf_map = std::fopen(path, "a");
+    }
+#endif
+}
+
+JitCode::JitCode(Chip8 const& chip8)
+{
+#ifdef CHIP8_JIT_X86_64
+    void* mapping = mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mapping == MAP_FAILED) {
+        return;
+    }
+    arena = static_cast<uint8_t*>(mapping);
+
+    entries.assign(MEMORY_SIZE, nullptr);
+    heat.assign(MEMORY_SIZE, 0);
+    refused.assign(MEMORY_SIZE, 0);
+
+    uint8_t const* base = reinterpret_cast<uint8_t const*>(&chip8);
+    int32_t pc = int32_t(reinterpret_cast<uint8_t const*>(&chip8.program_counter) - base);
+
+    Assembler code(arena, 0);
+
+    //uint64_t enter(Chip8*, uint64_t budget, uint8_t* block, uint8_t** entries)
+    code.Bytes({0x53, 0x55, 0x41, 0x54, 0x41, 0x55});   //push rbx, rbp, r12, r13
+    code.Bytes({0x48, 0x83, 0xEC, 0x08});               //sub rsp, 8 to keep calls aligned
+    code.Bytes({0x48, 0x89, 0xFB});                     //mov rbx, rdi
+    code.Bytes({0x48, 0x89, 0xF5});                     //mov rbp, rsi
+    code.Bytes({0x49, 0x89, 0xF5});                     //mov r13, rsi
+    code.Bytes({0x49, 0x89, 0xCC});                     //mov r12, rcx
+    code.Bytes({0xFF, 0xE2});                           //jmp rdx
+
+    //Returns the instructions run
+    leave = code.Here();
+    code.Bytes({0x4C, 0x89, 0xE8});                     //mov rax, r13
+    code.Bytes({0x48, 0x29, 0xE8});                     //sub rax, rbp
+    code.Bytes({0x48, 0x83, 0xC4, 0x08});               //add rsp, 8
+    code.Bytes({0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B});   //pop r13, r12, rbp, rbx
+    code.Bytes({0xC3});                                 //ret
+
+    //Continues at the pc if a block starts there, otherwise leaves
+    dispatch = code.Here();
+    code.LoadWord(RAX, pc);
+    code.Alu(CMP, RAX, LAST_ADDRESS);
+    code.JumpTo(ABOVE, leave);
+    code.Bytes({0x49, 0x8B, 0x0C, 0xC4});               //mov rcx, [r12 + rax * 8]
+    code.Bytes({0x48, 0x85, 0xC9});                     //test rcx, rcx
+    code.JumpTo(EQUAL, leave);
+    code.Bytes({0xFF, 0xE1});                           //jmp rcx
+
+    first_block = code.Here();
+    used = first_block;
+
+    //Without an executable arena nothing is translated
+    if(!set_writable(arena, false))
+    {
+        munmap(arena, ARENA_SIZE);
+        arena = nullptr;
+        return;
+    }
+
+    write_perf_symbol(arena, first_block, "chip8_jit_stubs");
+#else
+    (void)chip8;
+#endif
+}
+
+JitCode::~JitCode()
+{
+#ifdef CHIP8_JIT_X86_64
+    if(arena) {
+        munmap(arena, ARENA_SIZE);
+    }
+#endif
+}
+
+uint64_t JitCode::Run(Chip8& chip8, uint64_t budget)
+{
+#ifdef CHIP8_JIT_X86_64
+    uint16_t pc = chip8.program_counter;
+    if(!arena || pc > LAST_ADDRESS) {
+        return 0;
+    }
+
+    uint8_t* block = entries[pc];
+    if(!block)
+    {
+        if(refused[pc]) {
+            return 0;
+        }
+        if(heat[pc] < HOT_THRESHOLD)
+        {
+            heat[pc]++;
+            return 0;
+        }
+        block = translate(chip8, pc);
+        if(!block) {
+            return 0;
+        }
+    }
+
+    typedef uint64_t (*Enter)(Chip8*, uint64_t, uint8_t*, uint8_t**);
+    return reinterpret_cast<Enter>(arena)(&chip8, budget, block, entries.data());
+#else
+    (void)chip8;
+    (void)budget;
+    return 0;
+#endif
+}
+
+void JitCode::Flush(Chip8& chip8)
+{
+    used = first_block;
+    std::fill(entries.begin(), entries.end(), nullptr);
+    std::fill(refused.begin(), refused.end(), 0);
+
+    //Code that keeps being rewritten has to get hot again before it is
+    //translated again
+    std::fill(heat.begin(), heat.end(), 0);
+    links.clear();
+
+    std::fill(chip8.cache.jit_code.begin(), chip8.cache.jit_code.end(), 0);
+    chip8.cache.jit_dirty = false;
+}
+
+void JitCode::execute(Chip8* chip8, uint32_t opcode)
+{
+    Chip8::Instruction op = chip8->decode(static_cast<uint16_t>(opcode));
+    op.handler = chip8->resolve(static_cast<uint16_t>(opcode));
+    ((*chip8).*op.handler)(op);
+}
+
+uint8_t* JitCode::translate(Chip8& chip8, uint16_t start)
+{
+#ifdef CHIP8_JIT_X86_64
+    //Straight-line run up to a branch, skip or store, or up to an
+    //instruction that only the interpreter runs
+    uint16_t opcodes[MAX_BLOCK_LENGTH];
+    unsigned int length = 0;
+    bool ended = false;
+
+    for(unsigned int address = start; length < MAX_BLOCK_LENGTH && address <= LAST_ADDRESS; address += 2)
+    {
+        uint16_t opcode = uint16_t(chip8.memory[address] << 8u | chip8.memory[address + 1]);
+        Chip8::Chip8Func handler = chip8.resolve(opcode);
+
+        //Bnnn jumps to a computed address, Fx0A and Fx18 have to yield
+        if(handler == &Chip8::OP_NULL || handler == chip8.table[0xB]
+           || handler == &Chip8::OP_Fx0A || handler == &Chip8::OP_Fx18) {
+            break;
+        }
+
+        //OP_1nnn yields on these so RunFor can skip the loop
+        if(handler == &Chip8::OP_1nnn && chip8.jumps_into_idle_loop(uint16_t(address), opcode & 0x0FFFu)) {
+            break;
+        }
+
+        opcodes[length++] = opcode;
+        if(chip8.ends_block(handler))
+        {
+            ended = true;
+            break;
+        }
+    }
+
+    if(length == 0)
+    {
+        refused[start] = 1;
+        return nullptr;
+    }
+
+    if(used + MAX_BLOCK_BYTES > ARENA_SIZE) {
+        Flush(chip8);
+    }
+
+    if(!set_writable(arena, true))
+    {
+        refused[start] = 1;
+        return nullptr;
+    }
+
+    uint8_t const* base = reinterpret_cast<uint8_t const*>(&chip8);
+    auto offset = [base](void const* member) {
+        return int32_t(reinterpret_cast<uint8_t const*>(member) - base);
+    };
+    Layout layout {
+        offset(chip8.registers), offset(&chip8.index_register), offset(&chip8.program_counter),
+        offset(chip8.stack), offset(&chip8.stack_pointer), offset(&chip8.delay_timer),
+        offset(&chip8.cache.jit_dirty)
+    };
+    Policy policy = policy_for(chip8.quirks);
+
+    //Guest registers the inlined instructions touch, and which they write
+    unsigned int uses[16] = {};
+    uint16_t written = 0;
+    for(unsigned int i = 0; i < length; i++)
+    {
+        uint16_t opcode = opcodes[i];
+        unsigned int x = (opcode >> 8u) & 0xFu;
+        unsigned int y = (opcode >> 4u) & 0xFu;
+
+        switch(opcode >> 12u)
+        {
+            case 0x3: case 0x4:
+                uses[x]++;
+                break;
+            case 0x5: case 0x9:
+                uses[x]++;
+                uses[y]++;
+                break;
+            case 0x6: case 0x7:
+                uses[x]++;
+                written |= 1u << x;
+                break;
+            case 0x8:
+                uses[x]++;
+                uses[y]++;
+                uses[0xF]++;
+                written |= 1u << x | 1u << 0xF;
+                break;
+            case 0xF:
+                if((opcode & 0xFFu) == 0x07 || (opcode & 0xFFu) == 0x15 || (opcode & 0xFFu) == 0x1E) {
+                    uses[x]++;
+                }
+                if((opcode & 0xFFu) == 0x07) {
+                    written |= 1u << x;
+                }
+                break;
+        }
+    }
+
+    //The most used registers get host registers; RAX means none
+    Reg host[16] = {};
+    unsigned int order[16];
+    for(unsigned int v = 0; v < 16; v++) {
+        order[v] = v;
+    }
+    std::stable_sort(order, order + 16, [&uses](unsigned int a, unsigned int b) { return uses[a] > uses[b]; });
+    for(unsigned int i = 0; i < sizeof(CACHE_REGS) / sizeof(CACHE_REGS[0]) && uses[order[i]] >= 2; i++) {
+        host[order[i]] = CACHE_REGS[i];
+    }
+
+    Assembler code(arena, used);
+    uint8_t* entry = arena + used;
+
+    //Registered first so a block that loops to its own start chains to itself
+    entries[start] = entry;
+
+    auto load = [&](Reg dst, unsigned int v) {
+        if(host[v] != RAX) {
+            code.Move(dst, host[v]);
+        }
+        else {
+            code.LoadByte(dst, layout.registers + v);
+        }
+    };
+    auto store = [&](unsigned int v, Reg src) {
+        if(host[v] != RAX) {
+            code.ZeroExtendByte(host[v], src);
+        }
+        else {
+            code.StoreByte(layout.registers + v, src);
+        }
+    };
+    auto spill = [&]() {
+        for(unsigned int v = 0; v < 16; v++) {
+            if(host[v] != RAX && (written & (1u << v))) {
+                code.StoreByte(layout.registers + v, host[v]);
+            }
+        }
+    };
+    auto reload = [&]() {
+        for(unsigned int v = 0; v < 16; v++) {
+            if(host[v] != RAX) {
+                code.LoadByte(host[v], layout.registers + v);
+            }
+        }
+    };
+
+    std::size_t body = 0;
+
+    //Continues at target, which keeps the registers cached if it is this block
+    auto exit_to = [&](unsigned int target) {
+        if(target == start)
+        {
+            code.JumpTo(body);
+            return;
+        }
+        spill();
+        code.StoreWord(layout.pc, static_cast<uint16_t>(target));
+        if(target <= LAST_ADDRESS && entries[target])
+        {
+            code.JumpTo(entries[target] - arena);
+            return;
+        }
+        std::size_t site = code.Jump();
+        code.Patch(site, leave);
+        if(target <= LAST_ADDRESS && !refused[target]) {
+            links.push_back(Link {site, static_cast<uint16_t>(target)});
+        }
+    };
+
+    //Hands instruction i back to the interpreter, which will fault on it
+    auto give_back = [&](unsigned int i) {
+        spill();
+        code.Budget(ADD, 1);
+        code.StoreWord(layout.pc, static_cast<uint16_t>(start + 2 * i));
+        code.JumpTo(leave);
+    };
+
+    //Runs the interpreter's handler with the pc as it would be after fetch
+    auto call_handler = [&](unsigned int address, uint16_t opcode) {
+        spill();
+        code.StoreWord(layout.pc, static_cast<uint16_t>(address + 2));
+        code.Bytes({0x48, 0x89, 0xDF});                 //mov rdi, rbx
+        code.Move(RSI, static_cast<uint32_t>(opcode));
+        code.Bytes({0x48, 0xB8});                       //mov rax, execute
+        code.Int64(reinterpret_cast<uint64_t>(&JitCode::execute));
+        code.Bytes({0xFF, 0xD0});                       //call rax
+        reload();
+    };
+
+    auto skip_if = [&](Cond taken, unsigned int address) {
+        std::size_t site = code.Jump(taken);
+        exit_to(address + 2);
+        code.Bind(site);
+        exit_to(address + 4);
+    };
+
+    reload();
+    body = code.Here();
+
+    //One jb per instruction, taken when the budget has run out
+    std::size_t out_of_budget[MAX_BLOCK_LENGTH];
+
+    for(unsigned int i = 0; i < length; i++)
+    {
+        unsigned int address = start + 2 * i;
+
+        code.Budget(SUB, 1);
+        out_of_budget[i] = code.Jump(BELOW);
+
+        uint16_t opcode = opcodes[i];
+        unsigned int x = (opcode >> 8u) & 0xFu;
+        unsigned int y = (opcode >> 4u) & 0xFu;
+        uint8_t kk = opcode & 0xFFu;
+        uint16_t nnn = opcode & 0x0FFFu;
+        unsigned int source = policy.shiftFromVy ? y : x;
+
+        switch(opcode >> 12u)
+        {
+            case 0x0:
+                if((opcode & 0xFu) == 0xE)
+                {
+                    //00EE
+                    code.LoadByte(RAX, layout.sp);
+                    code.Alu(CMP, RAX, 0u);
+                    std::size_t ok = code.Jump(NOT_EQUAL);
+                    give_back(i);
+                    code.Bind(ok);
+                    code.Alu(SUB, RAX, 1u);
+                    code.StoreByte(layout.sp, RAX);
+                    code.Bytes({0x0F, 0xB7, 0x84, 0x43});   //movzx eax, word [rbx + rax * 2 + stack]
+                    code.Int32(layout.stack);
+                    code.StoreWord(layout.pc, RAX);
+                    spill();
+                    code.JumpTo(dispatch);
+                }
+                else {
+                    call_handler(address, opcode);
+                }
+                break;
+
+            case 0x1:
+                exit_to(nnn);
+                break;
+
+            case 0x2:
+            {
+                code.LoadByte(RAX, layout.sp);
+                code.Alu(CMP, RAX, 16u);
+                std::size_t ok = code.Jump(BELOW);
+                give_back(i);
+                code.Bind(ok);
+                code.Bytes({0x66, 0xC7, 0x84, 0x43});       //mov word [rbx + rax * 2 + stack], return address
+                code.Int32(layout.stack);
+                code.Int16(static_cast<uint16_t>(address + 2));
+                code.Bytes({0xFE, 0x83});                   //inc byte [rbx + sp]
+                code.Int32(layout.sp);
+                exit_to(nnn);
+                break;
+            }
+
+            case 0x3:
+                load(RAX, x);
+                code.Alu(CMP, RAX, kk);
+                skip_if(EQUAL, address);
+                break;
+
+            case 0x4:
+                load(RAX, x);
+                code.Alu(CMP, RAX, kk);
+                skip_if(NOT_EQUAL, address);
+                break;
+
+            case 0x5:
+                load(RAX, x);
+                load(RCX, y);
+                code.Alu(CMP, RAX, RCX);
+                skip_if(EQUAL, address);
+                break;
+
+            case 0x9:
+                load(RAX, x);
+                load(RCX, y);
+                code.Alu(CMP, RAX, RCX);
+                skip_if(NOT_EQUAL, address);
+                break;
+
+            case 0x6:
+                code.Move(RAX, uint32_t(kk));
+                store(x, RAX);
+                break;
+
+            case 0x7:
+                load(RAX, x);
+                code.Alu(ADD, RAX, uint32_t(kk));
+                store(x, RAX);
+                break;
+
+            case 0x8:
+                //Flags are written after the result, as the handlers do, so
+                //x = F behaves the same
+                switch(opcode & 0xFu)
+                {
+                    case 0x0:
+                        load(RAX, y);
+                        store(x, RAX);
+                        break;
+
+                    case 0x1: case 0x2: case 0x3:
+                        load(RAX, x);
+                        load(RCX, y);
+                        code.Alu((opcode & 0xFu) == 0x1 ? OR : (opcode & 0xFu) == 0x2 ? AND : XOR, RAX, RCX);
+                        store(x, RAX);
+                        if(policy.logicResetsVf)
+                        {
+                            code.Alu(XOR, RDX, RDX);
+                            store(0xF, RDX);
+                        }
+                        break;
+
+                    case 0x4:
+                        load(RAX, x);
+                        load(RCX, y);
+                        code.Alu(ADD, RAX, RCX);
+                        code.Move(RDX, RAX);
+                        code.ShiftRight(RDX, 8);
+                        store(x, RAX);
+                        store(0xF, RDX);
+                        break;
+
+                    case 0x5: case 0x7:
+                        load(RAX, (opcode & 0xFu) == 0x5 ? x : y);
+                        load(RCX, (opcode & 0xFu) == 0x5 ? y : x);
+                        code.Alu(XOR, RDX, RDX);
+                        code.Alu(CMP, RAX, RCX);
+                        code.SetAboveEqual(RDX);
+                        code.Alu(SUB, RAX, RCX);
+                        store(x, RAX);
+                        store(0xF, RDX);
+                        break;
+
+                    case 0x6:
+                        load(RAX, source);
+                        code.Move(RDX, RAX);
+                        code.Alu(AND, RDX, 1u);
+                        code.ShiftRight(RAX, 1);
+                        store(x, RAX);
+                        store(0xF, RDX);
+                        break;
+
+                    case 0xE:
+                        load(RAX, source);
+                        code.Move(RDX, RAX);
+                        code.ShiftRight(RDX, 7);
+                        code.ShiftLeft(RAX, 1);
+                        store(x, RAX);
+                        store(0xF, RDX);
+                        break;
+                }
+                break;
+
+            case 0xA:
+                code.StoreWord(layout.index, nnn);
+                break;
+
+            case 0xE:
+                //Ex9E and ExA1 move the pc themselves
+                call_handler(address, opcode);
+                code.LoadWord(RAX, layout.pc);
+                code.Alu(CMP, RAX, address + 4);
+                skip_if(EQUAL, address);
+                break;
+
+            case 0xF:
+                if(kk == 0x07)
+                {
+                    code.LoadByte(RAX, layout.delay);
+                    store(x, RAX);
+                }
+                else if(kk == 0x15)
+                {
+                    load(RAX, x);
+                    code.StoreByte(layout.delay, RAX);
+                }
+                else if(kk == 0x1E)
+                {
+                    code.LoadWord(RAX, layout.index);
+                    load(RCX, x);
+                    code.Alu(ADD, RAX, RCX);
+                    code.StoreWord(layout.index, RAX);
+                }
+                else if(kk == 0x33 || kk == 0x55)
+                {
+                    //A store into translated code leaves before anything
+                    //else runs from it
+                    call_handler(address, opcode);
+                    code.Bytes({0x80, 0xBB});               //cmp byte [rbx + dirty], 0
+                    code.Int32(layout.dirty);
+                    code.Bytes({0x00});
+                    code.JumpTo(NOT_EQUAL, leave);
+                    exit_to(address + 2);
+                }
+                else {
+                    //Fx29 and Fx65
+                    call_handler(address, opcode);
+                }
+                break;
+
+            default:
+                //Cxkk and Dxyn
+                call_handler(address, opcode);
+                break;
+        }
+    }
+
+    if(!ended) {
+        exit_to(start + 2 * length);
+    }
+
+    //Out of budget: give the unit back and leave on that instruction
+    std::size_t to_exit[MAX_BLOCK_LENGTH];
+    for(unsigned int i = 0; i < length; i++)
+    {
+        code.Bind(out_of_budget[i]);
+        code.StoreWord(layout.pc, static_cast<uint16_t>(start + 2 * i));
+        to_exit[i] = code.Jump();
+    }
+    for(unsigned int i = 0; i < length; i++) {
+        code.Bind(to_exit[i]);
+    }
+    code.Budget(ADD, 1);
+    spill();
+    code.JumpTo(leave);
+
+    //Jumps that were waiting for this block
+    for(std::size_t i = 0; i < links.size();)
+    {
+        if(links[i].target == start)
+        {
+            code.Patch(links[i].site, entry - arena);
+            links[i] = links.back();
+            links.pop_back();
+        }
+        else {
+            i++;
+        }
+    }
+
+    for(unsigned int address = start; address < start + 2 * length; address++) {
+        chip8.cache.jit_code[address] = 1;
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "chip8_block_%03X", start);
+    write_perf_symbol(entry, code.Here() - used, name);
+
+    used = code.Here();
+
+    //A block that cannot run is left to the interpreter
+    if(!set_writable(arena, false))
+    {
+        std::fill(entries.begin(), entries.end(), nullptr);
+        refused[start] = 1;
+        return nullptr;
+    }
+    return entry;
+#else
+    (void)chip8;
+    (void)start;
+    return nullptr;
+#endif
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "Chip8.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Native x86-64 translations of one machine's hot basic blocks, for
+//Engine::Jit. Blocks live in an executable arena and jump straight to each
+//other; anything they do not translate goes back through the interpreter.
+//On other hosts nothing is ever translated and Engine::Jit interprets.
+class JitCode {
+    public:
+        //False when this build has no backend for the host
+        static bool Supported();
+
+        //From now on appends "<start> <size> <name>" for every translated
+        //block to /tmp/perf-<pid>.map, so perf can attribute samples to guest
+        //code
+        static void EnablePerfMap();
+
+        //Field offsets are taken from chip8 and hold for every machine
+        explicit JitCode(Chip8 const& chip8);
+        ~JitCode();
+
+        JitCode(JitCode const&) = delete;
+        JitCode& operator=(JitCode const&) = delete;
+
+        //Runs native code from the pc for at most budget instructions and
+        //returns how many ran. 0 means the pc is on code that is cold or
+        //cannot be translated, or on a block longer than the budget.
+        uint64_t Run(Chip8& chip8, uint64_t budget);
+
+        //Drops every translation, after memory holding one was written
+        void Flush(Chip8& chip8);
+
+    private:
+        //A jump to a block that did not exist yet, patched once it does
+        struct Link {
+            std::size_t site;
+            uint16_t target;
+        };
+
+        uint8_t* arena {};
+        std::size_t used {};
+
+        //Where translated blocks start, after the shared entry, dispatch and
+        //exit stubs
+        std::size_t first_block {};
+        std::size_t dispatch {};
+        std::size_t leave {};
+
+        //Native entry per guest address, read by the dispatch stub
+        std::vector<uint8_t*> entries;
+
+        //Times the engine arrived at each address without a translation
+        std::vector<uint8_t> heat;
+
+        //Addresses whose first instruction is never translated
+        std::vector<uint8_t> refused;
+
+        std::vector<Link> links;
+
+        uint8_t* translate(Chip8& chip8, uint16_t start);
+
+        static void execute(Chip8* chip8, uint32_t opcode);
+};
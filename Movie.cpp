@@ -0,0 +1,96 @@
+#include "Movie.h"
+#include "Chip8.h"
+#include <cstring>
+#include <fstream>
+
+/*
+File layout, all integers little-endian:
+
+  "C8MV"  version:u8  seed:u64  rom_hash:u64  clock_rate:u32  frame_count:u32
+  keypad:u16 per frame
+*/
+
+static const char MOVIE_MAGIC[4] = {'C', '8', 'M', 'V'};
+static const uint8_t MOVIE_VERSION = 1;
+
+static void put(std::ofstream& file, uint64_t value, unsigned int bytes)
+{
+    for(unsigned int i = 0; i < bytes; i++) {
+        file.put(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+static uint64_t get(std::ifstream& file, unsigned int bytes)
+{
+    uint64_t value = 0;
+    for(unsigned int i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(file.get())) << (8 * i);
+    }
+    return value;
+}
+
+Movie::Movie(uint64_t seed, uint64_t romHash, uint32_t clockRate)
+    : seed(seed), rom_hash(romHash), clock_rate(clockRate)
+{}
+
+void Movie::Record(uint16_t keys)
+{
+    frames.push_back(keys);
+}
+
+bool Movie::Apply(std::size_t frame, uint16_t& keys) const
+{
+    if(frame >= frames.size()) {
+        return false;
+    }
+
+    keys = frames[frame];
+    return true;
+}
+
+bool Movie::Save(char const* path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if(!file.is_open()) {
+        return false;
+    }
+
+    file.write(MOVIE_MAGIC, sizeof(MOVIE_MAGIC));
+    put(file, MOVIE_VERSION, 1);
+    put(file, seed, 8);
+    put(file, rom_hash, 8);
+    put(file, clock_rate, 4);
+    put(file, frames.size(), 4);
+
+    for(uint16_t keys : frames) {
+        put(file, keys, 2);
+    }
+
+    return file.good();
+}
+
+bool Movie::Load(char const* path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open()) {
+        return false;
+    }
+
+    char magic[4];
+    file.read(magic, sizeof(magic));
+    if(!file || std::memcmp(magic, MOVIE_MAGIC, sizeof(magic)) != 0 || get(file, 1) != MOVIE_VERSION) {
+        return false;
+    }
+
+    seed = get(file, 8);
+    rom_hash = get(file, 8);
+    clock_rate = static_cast<uint32_t>(get(file, 4));
+
+    uint32_t count = static_cast<uint32_t>(get(file, 4));
+    frames.clear();
+    for(uint32_t frame = 0; frame < count && file; frame++) {
+        frames.push_back(static_cast<uint16_t>(get(file, 2)));
+    }
+
+    return file.good() && frames.size() == count;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Keypad input recorded once per 60 Hz frame. Together with the seed, ROM
+//and clock rate it replays a run bit for bit on any machine.
+class Movie {
+    public:
+        Movie() = default;
+
+        Movie(uint64_t seed, uint64_t romHash, uint32_t clockRate);
+
+        //Appends the keys held for the next frame, as passed to Chip8::SetKeys
+        void Record(uint16_t keys);
+
+        //Writes the keys recorded for frame into keys; false past the end
+        bool Apply(std::size_t frame, uint16_t& keys) const;
+
+        bool Save(char const* path) const;
+
+        bool Load(char const* path);
+
+        std::size_t FrameCount() const { return frames.size(); }
+
+        uint64_t GetSeed() const { return seed; }
+
+        uint64_t GetRomHash() const { return rom_hash; }
+
+        uint32_t GetClockRate() const { return clock_rate; }
+
+    private:
+        uint64_t seed {};
+        uint64_t rom_hash {};
+        uint32_t clock_rate {};
+
+        //One bit per key, bit n for key n
+        std::vector<uint16_t> frames;
+};
@@ -0,0 +1,67 @@
+#include "NullFrontend.h"
+#include "Beeper.h"
+#include "Chip8.h"
+#include <fstream>
+
+
+void NullFrontend::Update(void const* buffer, int pitch, uint32_t dirtyRows)
+{
+    frames++;
+
+    //An unchanged frame keeps the previous hash
+    if (dirtyRows != 0)
+    {
+        frame_hash = Chip8::HashBytes(static_cast<uint8_t const*>(buffer), static_cast<std::size_t>(pitch) * VIDEO_HEIGHT);
+    }
+}
+
+void NullFrontend::QueueAudio(float const* samples, std::size_t count)
+{
+    audio.insert(audio.end(), samples, samples + count);
+}
+
+//Little-endian whatever the host order
+static void put_le(std::ofstream& file, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        file.put(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+bool NullFrontend::WriteWav(char const* path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    uint32_t dataSize = static_cast<uint32_t>(audio.size() * 2);
+
+    file.write("RIFF", 4);
+    put_le(file, 36 + dataSize, 4);
+    file.write("WAVEfmt ", 8);
+    put_le(file, 16, 4);                     //fmt chunk size
+    put_le(file, 1, 2);                      //PCM
+    put_le(file, 1, 2);                      //Mono
+    put_le(file, AUDIO_SAMPLE_RATE, 4);
+    put_le(file, AUDIO_SAMPLE_RATE * 2, 4);  //Bytes per second
+    put_le(file, 2, 2);                      //Bytes per sample frame
+    put_le(file, 16, 2);                     //Bits per sample
+    file.write("data", 4);
+    put_le(file, dataSize, 4);
+
+    for (float sample : audio)
+    {
+        float clamped = sample < -1.0f ? -1.0f : (sample > 1.0f ? 1.0f : sample);
+        put_le(file, static_cast<uint16_t>(static_cast<int16_t>(clamped * 32767.0f)), 2);
+    }
+
+    return static_cast<bool>(file);
+}
+
+bool NullFrontend::ProcessInput(uint16_t&)
+{
+    return false;
+}
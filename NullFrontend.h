@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Frontend.h"
+#include <vector>
+
+
+//Discards video and never presses a key; keeps just enough to check a
+//run: frames presented, a hash of the last frame and every audio sample,
+//which WriteWav saves for listening to or comparing
+class NullFrontend : public Frontend
+{
+public:
+    void Update(void const* buffer, int pitch, uint32_t dirtyRows) override;
+    void QueueAudio(float const* samples, std::size_t count) override;
+    bool ProcessInput(uint16_t& keys) override;
+
+    uint64_t GetFrameCount() const { return frames; }
+    uint64_t GetFrameHash() const { return frame_hash; }
+    std::vector<float> const& GetAudio() const { return audio; }
+
+    //16-bit mono PCM at AUDIO_SAMPLE_RATE; false if the file cannot be written
+    bool WriteWav(char const* path) const;
+
+private:
+    uint64_t frames{};
+    std::vector<float> audio;
+    uint64_t frame_hash{};
+};
@@ -1,36 +1,112 @@
 #include "Platform.h"
+#include "Beeper.h"
+#include "Chip8.h"
 #include <SDL2/SDL.h>
+#include <cstring>
 
 
-Platform::Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight)
+//Queued audio beyond this is dropped so latency cannot build up when the
+//emulation clock runs slightly ahead of the audio device
+static const std::size_t MAX_QUEUED_SAMPLES = 4 * SAMPLES_PER_FRAME;
+
+//Runs on SDL's audio thread: only copies out of the ring, padding an
+//underrun with silence
+static void audio_callback(void* userdata, Uint8* stream, int len)
+{
+    SampleRing<float>& ring = *static_cast<SampleRing<float>*>(userdata);
+
+    float* out = reinterpret_cast<float*>(stream);
+    std::size_t wanted = static_cast<std::size_t>(len) / sizeof(float);
+    std::size_t got = ring.Pop(out, wanted);
+
+    std::memset(out + got, 0, (wanted - got) * sizeof(float));
+}
+
+
+Platform::Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight, bool vsync)
 {
-    SDL_Init(SDL_INIT_VIDEO);
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
 
     window = SDL_CreateWindow(title, 0, 0, windowWidth, windowHeight, SDL_WINDOW_SHOWN);
 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
 
     texture = SDL_CreateTexture(
         renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, textureWidth, textureHeight);
+
+    SDL_AudioSpec want{};
+    want.freq = AUDIO_SAMPLE_RATE;
+    want.format = AUDIO_F32SYS;
+    want.channels = 1;
+    want.samples = 512;
+    want.callback = audio_callback;
+    want.userdata = &audioRing;
+
+    //Without a device the emulator runs silent
+    audioDevice = SDL_OpenAudioDevice(nullptr, 0, &want, nullptr, 0);
+    if (audioDevice != 0)
+    {
+        SDL_PauseAudioDevice(audioDevice, 0);
+    }
 }
 
 Platform::~Platform()
 {
+    if (audioDevice != 0)
+    {
+        SDL_CloseAudioDevice(audioDevice);
+    }
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 }
 
-void Platform::Update(void const* buffer, int pitch)
+void Platform::Update(void const* buffer, int pitch, uint32_t dirtyRows)
 {
-    SDL_UpdateTexture(texture, nullptr, buffer, pitch);
+    if (dirtyRows != 0)
+    {
+        //Upload the band between the first and last changed row
+        int first = 0;
+        while (!(dirtyRows & (1u << first)))
+        {
+            first++;
+        }
+
+        int last = 31;
+        while (!(dirtyRows & (1u << last)))
+        {
+            last--;
+        }
+
+        SDL_Rect band{0, first, pitch / static_cast<int>(sizeof(uint32_t)), last - first + 1};
+        SDL_UpdateTexture(texture, &band, static_cast<uint8_t const*>(buffer) + first * pitch, pitch);
+    }
+
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, texture, nullptr, nullptr);
     SDL_RenderPresent(renderer);
 }
 
-bool Platform::ProcessInput(uint8_t* keys)
+void Platform::QueueAudio(float const* samples, std::size_t count)
+{
+    if (audioDevice == 0 || audioRing.Size() + count > MAX_QUEUED_SAMPLES)
+    {
+        return;
+    }
+
+    audioRing.Push(samples, count);
+}
+
+void Platform::BindKey(unsigned int key, int32_t keycode)
+{
+    if (key < KEY_COUNT)
+    {
+        bindings[key] = keycode;
+    }
+}
+
+bool Platform::ProcessInput(uint16_t& keys)
 {
     bool quit = false;
 
@@ -38,189 +114,42 @@ bool Platform::ProcessInput(uint8_t* keys)
 
     while (SDL_PollEvent(&event))
     {
-        switch (event.type)
+        if (event.type == SDL_QUIT)
         {
-            case SDL_QUIT:
+            quit = true;
+        }
+        else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
+        {
+            SDL_Keycode sym = event.key.keysym.sym;
+
+            if (sym == SDLK_ESCAPE)
             {
                 quit = true;
-            } break;
+                continue;
+            }
 
-            case SDL_KEYDOWN:
+            if (sym == SDLK_BACKSPACE)
             {
-                switch (event.key.keysym.sym)
+                rewindHeld = event.type == SDL_KEYDOWN;
+                continue;
+            }
+
+            for (unsigned int key = 0; key < KEY_COUNT; key++)
+            {
+                if (bindings[key] != sym)
                 {
-                    case SDLK_ESCAPE:
-                    {
-                        quit = true;
-                    } break;
-
-                    case SDLK_x:
-                    {
-                        keys[0] = 1;
-                    } break;
-
-                    case SDLK_1:
-                    {
-                        keys[1] = 1;
-                    } break;
-
-                    case SDLK_2:
-                    {
-                        keys[2] = 1;
-                    } break;
-
-                    case SDLK_3:
-                    {
-                        keys[3] = 1;
-                    } break;
-
-                    case SDLK_q:
-                    {
-                        keys[4] = 1;
-                    } break;
-
-                    case SDLK_w:
-                    {
-                        keys[5] = 1;
-                    } break;
-
-                    case SDLK_e:
-                    {
-                        keys[6] = 1;
-                    } break;
-
-                    case SDLK_a:
-                    {
-                        keys[7] = 1;
-                    } break;
-
-                    case SDLK_s:
-                    {
-                        keys[8] = 1;
-                    } break;
-
-                    case SDLK_d:
-                    {
-                        keys[9] = 1;
-                    } break;
-
-                    case SDLK_z:
-                    {
-                        keys[0xA] = 1;
-                    } break;
-
-                    case SDLK_c:
-                    {
-                        keys[0xB] = 1;
-                    } break;
-
-                    case SDLK_4:
-                    {
-                        keys[0xC] = 1;
-                    } break;
-
-                    case SDLK_r:
-                    {
-                        keys[0xD] = 1;
-                    } break;
-
-                    case SDLK_f:
-                    {
-                        keys[0xE] = 1;
-                    } break;
-
-                    case SDLK_v:
-                    {
-                        keys[0xF] = 1;
-                    } break;
+                    continue;
                 }
-            } break;
 
-            case SDL_KEYUP:
-            {
-                switch (event.key.keysym.sym)
+                if (event.type == SDL_KEYDOWN)
+                {
+                    keys |= 1u << key;
+                }
+                else
                 {
-                    case SDLK_x:
-                    {
-                        keys[0] = 0;
-                    } break;
-
-                    case SDLK_1:
-                    {
-                        keys[1] = 0;
-                    } break;
-
-                    case SDLK_2:
-                    {
-                        keys[2] = 0;
-                    } break;
-
-                    case SDLK_3:
-                    {
-                        keys[3] = 0;
-                    } break;
-
-                    case SDLK_q:
-                    {
-                        keys[4] = 0;
-                    } break;
-
-                    case SDLK_w:
-                    {
-                        keys[5] = 0;
-                    } break;
-
-                    case SDLK_e:
-                    {
-                        keys[6] = 0;
-                    } break;
-
-                    case SDLK_a:
-                    {
-                        keys[7] = 0;
-                    } break;
-
-                    case SDLK_s:
-                    {
-                        keys[8] = 0;
-                    } break;
-
-                    case SDLK_d:
-                    {
-                        keys[9] = 0;
-                    } break;
-
-                    case SDLK_z:
-                    {
-                        keys[0xA] = 0;
-                    } break;
-
-                    case SDLK_c:
-                    {
-                        keys[0xB] = 0;
-                    } break;
-
-                    case SDLK_4:
-                    {
-                        keys[0xC] = 0;
-                    } break;
-
-                    case SDLK_r:
-                    {
-                        keys[0xD] = 0;
-                    } break;
-
-                    case SDLK_f:
-                    {
-                        keys[0xE] = 0;
-                    } break;
-
-                    case SDLK_v:
-                    {
-                        keys[0xF] = 0;
-                    } break;
+                    keys &= ~(1u << key);
                 }
-            } break;
+            }
         }
     }
 
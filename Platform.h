@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Frontend.h"
+#include "SampleRing.h"
 #include <cstdint>
 
 
@@ -8,16 +10,33 @@ class SDL_Renderer;
 class SDL_Texture;
 
 
-class Platform
+class Platform : public Frontend
 {
 public:
-    Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight);
-    ~Platform();
-    void Update(void const* buffer, int pitch);
-    bool ProcessInput(uint8_t* keys);
+    Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight, bool vsync = false);
+    ~Platform() override;
+    //Uploads only the rows set in dirtyRows before presenting; 0 skips the upload
+    void Update(void const* buffer, int pitch, uint32_t dirtyRows) override;
+    //Queues for the audio callback, dropping samples past a few frames of lag
+    void QueueAudio(float const* samples, std::size_t count) override;
+    //Sets or clears bits in keys as bound keys go down and up
+    bool ProcessInput(uint16_t& keys) override;
+    //Maps CHIP-8 key 0-F to an SDL keycode
+    void BindKey(unsigned int key, int32_t keycode);
+    //Whether Backspace, the rewind key, is down as of the last ProcessInput
+    bool IsRewindHeld() const { return rewindHeld; }
 
 private:
     SDL_Window* window{};
     SDL_Renderer* renderer{};
     SDL_Texture* texture{};
+    bool rewindHeld{};
+
+    //Filled by QueueAudio, drained by the SDL audio callback; 0 when no
+    //audio device could be opened
+    SampleRing<float> audioRing{8192};
+    uint32_t audioDevice{};
+
+    //SDL keycode per CHIP-8 key; letters and digits are their ASCII codes
+    int32_t bindings[16]{'x', '1', '2', '3', 'q', 'w', 'e', 'a', 's', 'd', 'z', 'c', '4', 'r', 'f', 'v'};
 };
\ No newline at end of file
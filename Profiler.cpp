@@ -0,0 +1,104 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <iomanip>
+
+static char const* const CLASS_NAMES[InstructionProfiler::CLASS_COUNT] =
+{
+    "00E0", "00EE", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk", "7xkk",
+    "8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5", "8xy6", "8xy7", "8xyE",
+    "9xy0", "Annn", "Bnnn", "Cxkk", "Dxyn", "Ex9E", "ExA1",
+    "Fx07", "Fx0A", "Fx15", "Fx18", "Fx1E", "Fx29", "Fx33", "Fx55", "Fx65",
+    "NULL"
+};
+
+static const unsigned int NULL_CLASS = InstructionProfiler::CLASS_COUNT - 1;
+
+//Mirrors the table/table0/table8/tableE/tableF layout in Chip8
+unsigned int InstructionProfiler::OpcodeClass(uint16_t opcode)
+{
+    unsigned int n = opcode & 0x000Fu;
+    unsigned int kk = opcode & 0x00FFu;
+
+    switch(opcode >> 12u)
+    {
+        case 0x0: return n == 0x0 ? 0 : n == 0xE ? 1 : NULL_CLASS;
+        case 0x8:
+            if(n <= 0x7) {
+                return 9 + n;
+            }
+            return n == 0xE ? 17 : NULL_CLASS;
+        case 0x9: return 18;
+        case 0xA: return 19;
+        case 0xB: return 20;
+        case 0xC: return 21;
+        case 0xD: return 22;
+        case 0xE: return n == 0xE ? 23 : n == 0x1 ? 24 : NULL_CLASS;
+        case 0xF:
+            switch(kk)
+            {
+                case 0x07: return 25;
+                case 0x0A: return 26;
+                case 0x15: return 27;
+                case 0x18: return 28;
+                case 0x1E: return 29;
+                case 0x29: return 30;
+                case 0x33: return 31;
+                case 0x55: return 32;
+                case 0x65: return 33;
+                default: return NULL_CLASS;
+            }
+        default: return 1 + (opcode >> 12u);
+    }
+}
+
+char const* InstructionProfiler::ClassName(unsigned int opcodeClass)
+{
+    return opcodeClass < CLASS_COUNT ? CLASS_NAMES[opcodeClass] : "?";
+}
+
+void InstructionProfiler::WriteFlatProfile(std::ostream& out) const
+{
+    unsigned int order[CLASS_COUNT];
+    for(unsigned int i = 0; i < CLASS_COUNT; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order, order + CLASS_COUNT, [this](unsigned int a, unsigned int b) {
+        return class_counts[a] > class_counts[b];
+    });
+
+    out << "class       count      %\n";
+    for(unsigned int i = 0; i < CLASS_COUNT && class_counts[order[i]] > 0; i++)
+    {
+        uint64_t count = class_counts[order[i]];
+        out << std::left << std::setw(6) << ClassName(order[i]) << std::right
+            << std::setw(12) << count << std::setw(7) << std::fixed << std::setprecision(2)
+            << 100.0 * count / instructions << "\n";
+    }
+
+    double drawMs = std::chrono::duration<double, std::milli>(draw_time).count();
+    double hostMs = std::chrono::duration<double, std::milli>(host_update_time).count();
+    uint64_t draws = class_counts[22];
+
+    out << "\ninstructions      " << instructions << "\n";
+    out << "key wait cycles   " << key_wait_cycles << "\n";
+    out << "Dxyn time         " << drawMs << " ms";
+    if(draws > 0) {
+        out << " (" << drawMs * 1e6 / draws << " ns/draw)";
+    }
+    out << "\nhost update time  " << hostMs << " ms";
+    if(host_updates > 0) {
+        out << " (" << hostMs / host_updates << " ms/frame)";
+    }
+    out << "\n";
+}
+
+void InstructionProfiler::WriteHeatmap(std::ostream& out) const
+{
+    out << "address,count\n";
+    for(unsigned int address = 0; address < 4096; address++)
+    {
+        if(address_counts[address] > 0) {
+            out << address << "," << address_counts[address] << "\n";
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+//Profiling policies for Chip8::Cycle(Profiler&). Every hook of
+//NullProfiler is an empty inline function and ENABLED lets the core drop
+//the bookkeeping around them, so the plain Cycle() path pays nothing.
+struct NullProfiler {
+    static const bool ENABLED = false;
+
+    void OnInstruction(uint16_t, uint16_t) {}
+    void OnDraw(std::chrono::steady_clock::duration) {}
+    void OnKeyWait() {}
+    void OnHostUpdate(std::chrono::steady_clock::duration) {}
+};
+
+//Counts executions per opcode class and per address, time spent in Dxyn
+//and in the host's present call, and cycles spent blocked in Fx0A
+class InstructionProfiler {
+    public:
+        static const bool ENABLED = true;
+
+        //One class per leaf of the dispatch tables plus one for OP_NULL
+        static const unsigned int CLASS_COUNT = 35;
+
+        static unsigned int OpcodeClass(uint16_t opcode);
+
+        static char const* ClassName(unsigned int opcodeClass);
+
+        void OnInstruction(uint16_t address, uint16_t opcode)
+        {
+            class_counts[OpcodeClass(opcode)]++;
+            address_counts[address & 0xFFFu]++;
+            instructions++;
+        }
+
+        void OnDraw(std::chrono::steady_clock::duration time)
+        {
+            draw_time += time;
+        }
+
+        void OnKeyWait()
+        {
+            key_wait_cycles++;
+        }
+
+        void OnHostUpdate(std::chrono::steady_clock::duration time)
+        {
+            host_update_time += time;
+            host_updates++;
+        }
+
+        //Opcode classes by descending count, then the timing totals
+        void WriteFlatProfile(std::ostream& out) const;
+
+        //address,count for every address that executed at least once
+        void WriteHeatmap(std::ostream& out) const;
+
+    private:
+        uint64_t class_counts[CLASS_COUNT] {};
+        uint64_t address_counts[4096] {};
+        uint64_t instructions {};
+        uint64_t key_wait_cycles {};
+        uint64_t host_updates {};
+        std::chrono::steady_clock::duration draw_time {};
+        std::chrono::steady_clock::duration host_update_time {};
+};
@@ -0,0 +1,88 @@
+#include "Quirks.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+char const* QuirkProfileName(QuirkProfile profile)
+{
+    switch(profile)
+    {
+        case QuirkProfile::CosmacVip: return "vip";
+        case QuirkProfile::Chip48: return "chip48";
+        case QuirkProfile::SuperChip: return "schip";
+    }
+    return "unknown";
+}
+
+bool ParseQuirkProfile(char const* name, QuirkProfile& profile)
+{
+    if(std::strcmp(name, "vip") == 0) {
+        profile = QuirkProfile::CosmacVip;
+    }
+    else if(std::strcmp(name, "chip48") == 0) {
+        profile = QuirkProfile::Chip48;
+    }
+    else if(std::strcmp(name, "schip") == 0) {
+        profile = QuirkProfile::SuperChip;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+QuirkDatabase& QuirkDatabase::Global()
+{
+    static QuirkDatabase database;
+    return database;
+}
+
+void QuirkDatabase::Add(uint64_t romHash, QuirkProfile profile)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    profiles[romHash] = profile;
+}
+
+bool QuirkDatabase::Load(char const* path)
+{
+    std::ifstream file(path);
+    if(!file) {
+        return false;
+    }
+
+    std::string line;
+    while(std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        std::string hash, name;
+        if(!(fields >> hash)) {
+            continue;
+        }
+
+        QuirkProfile profile;
+        char* end = nullptr;
+        uint64_t romHash = std::strtoull(hash.c_str(), &end, 16);
+        if(*end != '\0' || !(fields >> name) || !ParseQuirkProfile(name.c_str(), profile)) {
+            return false;
+        }
+
+        Add(romHash, profile);
+    }
+    return true;
+}
+
+bool QuirkDatabase::Find(uint64_t romHash, QuirkProfile& profile)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto entry = profiles.find(romHash);
+    if(entry == profiles.end()) {
+        return false;
+    }
+    profile = entry->second;
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+//Where Fx55 and Fx65 leave the index register
+enum class IndexQuirk {
+    Unchanged,
+    AddX,
+    AddXPlusOne
+};
+
+//Compile-time quirk policies. Chip8 instantiates the handlers that differ
+//between interpreters once per policy and swaps them into its dispatch
+//tables, so the handlers themselves never test a flag.
+struct CosmacVipQuirks {
+    static constexpr bool SHIFT_FROM_VY = true;       //8xy6/8xyE shift Vy into Vx
+    static constexpr IndexQuirk LOAD_STORE_INDEX = IndexQuirk::AddXPlusOne;
+    static constexpr bool JUMP_USES_VX = false;       //Bnnn adds V0, not Vx
+    static constexpr bool WRAP_SPRITES = false;
+    static constexpr bool LOGIC_RESETS_VF = true;     //8xy1/8xy2/8xy3 clear VF
+};
+
+struct Chip48Quirks {
+    static constexpr bool SHIFT_FROM_VY = false;
+    static constexpr IndexQuirk LOAD_STORE_INDEX = IndexQuirk::AddX;
+    static constexpr bool JUMP_USES_VX = true;
+    static constexpr bool WRAP_SPRITES = false;
+    static constexpr bool LOGIC_RESETS_VF = false;
+};
+
+struct SuperChipQuirks {
+    static constexpr bool SHIFT_FROM_VY = false;
+    static constexpr IndexQuirk LOAD_STORE_INDEX = IndexQuirk::Unchanged;
+    static constexpr bool JUMP_USES_VX = true;
+    static constexpr bool WRAP_SPRITES = false;
+    static constexpr bool LOGIC_RESETS_VF = false;
+};
+
+//Any profile with sprites wrapping at the screen edges instead of clipping
+template<typename Quirks>
+struct WrappingQuirks : Quirks {
+    static constexpr bool WRAP_SPRITES = true;
+};
+
+enum class QuirkProfile : uint8_t {
+    CosmacVip,
+    Chip48,
+    SuperChip
+};
+
+char const* QuirkProfileName(QuirkProfile profile);
+
+//Accepts vip, chip48 and schip
+bool ParseQuirkProfile(char const* name, QuirkProfile& profile);
+
+//Known ROMs by content hash (Chip8::GetRomHash). Chip8 consults the global
+//database whenever a ROM is loaded and switches to the listed profile.
+class QuirkDatabase {
+    public:
+        static QuirkDatabase& Global();
+
+        void Add(uint64_t romHash, QuirkProfile profile);
+
+        //Reads lines of "<hex hash> <profile>"; blank lines and text after
+        //'#' are ignored. False if the file is missing or a line is invalid.
+        bool Load(char const* path);
+
+        bool Find(uint64_t romHash, QuirkProfile& profile);
+
+    private:
+        std::mutex lock;
+        std::map<uint64_t, QuirkProfile> profiles;
+};
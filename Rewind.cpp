@@ -0,0 +1,239 @@
+#include "Rewind.h"
+#include <cstring>
+
+/*
+Record encoding, over the bytes of a Snapshot XORed with its base (the
+keyframe for deltas, all zeroes for keyframes):
+
+  repeated  zeros:varint  literals:varint  bytes[literals]
+
+until the Snapshot is covered. Varints are 7 bits per byte, low first.
+*/
+
+static const std::size_t SNAPSHOT_SIZE = sizeof(Chip8::Snapshot);
+
+//Zero bytes shorter than this stay inside a literal run
+static const std::size_t MIN_ZERO_RUN = 4;
+
+static uint8_t* put_varint(uint8_t* out, std::size_t value)
+{
+    while(value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+static uint8_t const* get_varint(uint8_t const* in, std::size_t& value)
+{
+    value = 0;
+    for(unsigned int shift = 0; ; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<std::size_t>(byte & 0x7F) << shift;
+        if(!(byte & 0x80)) {
+            return in;
+        }
+    }
+}
+
+static uint64_t load_word(uint8_t const* bytes)
+{
+    uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+//Returns the encoded size; out needs room for 2 * SNAPSHOT_SIZE
+static std::size_t encode(uint8_t const* state, uint8_t const* base, uint8_t* out)
+{
+    uint8_t* start = out;
+    std::size_t i = 0;
+
+    while(i < SNAPSHOT_SIZE)
+    {
+        //Equal bytes, a word at a time where possible
+        std::size_t zeroStart = i;
+        while(i + 8 <= SNAPSHOT_SIZE && load_word(state + i) == load_word(base + i)) {
+            i += 8;
+        }
+        while(i < SNAPSHOT_SIZE && state[i] == base[i]) {
+            i++;
+        }
+
+        std::size_t literalStart = i;
+        while(i < SNAPSHOT_SIZE)
+        {
+            if(state[i] != base[i]) {
+                i++;
+                continue;
+            }
+
+            std::size_t gap = 0;
+            while(i + gap < SNAPSHOT_SIZE && gap < MIN_ZERO_RUN && state[i + gap] == base[i + gap]) {
+                gap++;
+            }
+            if(gap == MIN_ZERO_RUN || i + gap == SNAPSHOT_SIZE) {
+                break;
+            }
+            i += gap;
+        }
+
+        out = put_varint(out, literalStart - zeroStart);
+        out = put_varint(out, i - literalStart);
+        for(std::size_t j = literalStart; j < i; j++) {
+            *out++ = state[j] ^ base[j];
+        }
+    }
+
+    return static_cast<std::size_t>(out - start);
+}
+
+RewindBuffer::RewindBuffer(std::size_t budget, unsigned int keyframeInterval)
+    : ring(budget),
+      keyframe_interval(keyframeInterval > 0 ? keyframeInterval : 1),
+      scratch(2 * SNAPSHOT_SIZE + 16)
+{
+}
+
+std::size_t RewindBuffer::BytesUsed() const
+{
+    std::size_t used = 0;
+    for(Entry const& entry : entries) {
+        used += entry.size;
+    }
+    return used;
+}
+
+void RewindBuffer::drop_oldest()
+{
+    //Deltas are useless without their keyframe, so a group goes at once
+    do {
+        entries.pop_front();
+        first_frame++;
+    } while(!entries.empty() && !entries.front().keyframe);
+}
+
+std::size_t RewindBuffer::reserve(std::size_t size)
+{
+    for(;;)
+    {
+        if(entries.empty()) {
+            return 0;
+        }
+
+        std::size_t head = entries.front().offset;
+        if(tail > head)
+        {
+            //Live bytes are [head, tail); use the end, or wrap to the start
+            if(tail + size <= ring.size()) {
+                return tail;
+            }
+            if(size <= head) {
+                return 0;
+            }
+        }
+        else if(tail + size <= head)
+        {
+            //Live bytes wrap around; the gap is [tail, head)
+            return tail;
+        }
+
+        drop_oldest();
+    }
+}
+
+void RewindBuffer::Push(Chip8 const& chip8)
+{
+    static const Chip8::Snapshot zero {};
+    uint8_t const* state = reinterpret_cast<uint8_t const*>(&current);
+
+    //A zero budget turns rewind off
+    if(ring.empty()) {
+        return;
+    }
+
+    chip8.Capture(current);
+
+    bool keyframe = entries.empty() || since_keyframe + 1 >= keyframe_interval;
+    std::size_t size = encode(state, reinterpret_cast<uint8_t const*>(keyframe ? &zero : &key),
+                              scratch.data());
+    if(size > ring.size()) {
+        return;
+    }
+
+    std::size_t offset = reserve(size);
+    if(entries.empty() && !keyframe)
+    {
+        //The budget was so tight that this frame's own keyframe got evicted
+        keyframe = true;
+        size = encode(state, reinterpret_cast<uint8_t const*>(&zero), scratch.data());
+        if(size > ring.size()) {
+            return;
+        }
+    }
+
+    if(keyframe)
+    {
+        key = current;
+        since_keyframe = 0;
+    }
+    else
+    {
+        since_keyframe++;
+    }
+
+    std::memcpy(ring.data() + offset, scratch.data(), size);
+    entries.push_back(Entry {offset, static_cast<uint32_t>(size), keyframe});
+    tail = offset + size;
+}
+
+void RewindBuffer::decode(Entry const& entry, Chip8::Snapshot const& base, Chip8::Snapshot& out) const
+{
+    uint8_t* state = reinterpret_cast<uint8_t*>(&out);
+    std::memcpy(state, &base, SNAPSHOT_SIZE);
+
+    uint8_t const* in = ring.data() + entry.offset;
+    std::size_t i = 0;
+    while(i < SNAPSHOT_SIZE)
+    {
+        std::size_t zeros, literals;
+        in = get_varint(in, zeros);
+        in = get_varint(in, literals);
+
+        i += zeros;
+        for(std::size_t j = 0; j < literals; j++) {
+            state[i++] ^= *in++;
+        }
+    }
+}
+
+bool RewindBuffer::Seek(uint64_t frame, Chip8& chip8)
+{
+    if(entries.empty() || frame < first_frame || frame > NewestFrame()) {
+        return false;
+    }
+
+    std::size_t index = static_cast<std::size_t>(frame - first_frame);
+    std::size_t keyIndex = index;
+    while(!entries[keyIndex].keyframe) {
+        keyIndex--;
+    }
+
+    static const Chip8::Snapshot zero {};
+    decode(entries[keyIndex], zero, key);
+    if(keyIndex == index) {
+        current = key;
+    }
+    else {
+        decode(entries[index], key, current);
+    }
+
+    chip8.Restore(current);
+
+    //Later pushes continue from here, against the same keyframe
+    entries.resize(index + 1);
+    tail = entries.back().offset + entries.back().size;
+    since_keyframe = static_cast<unsigned int>(index - keyIndex);
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "Chip8.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+//Default budget; at a 60 frame keyframe interval this holds several minutes
+//of a typical game
+const std::size_t DEFAULT_REWIND_BUDGET = 16 * 1024 * 1024;
+
+//Always-on history of per-frame machine states inside a fixed byte budget.
+//Every keyframe_interval frames a keyframe is stored; the frames between
+//are stored as the XOR of their Snapshot with that keyframe, run-length
+//coded so only the bytes that changed take space. Seeking decodes the
+//keyframe and at most one delta. The oldest keyframe and its deltas are
+//dropped when the budget runs out.
+class RewindBuffer {
+    public:
+        explicit RewindBuffer(std::size_t budget, unsigned int keyframeInterval = 60);
+
+        //Records the machine as it is at the end of a frame. A frame that
+        //cannot fit in the whole budget is not recorded.
+        void Push(Chip8 const& chip8);
+
+        //Rolls chip8 back to a retained frame, numbered from 0 by Push, and
+        //forgets the frames after it. chip8 must be the machine that was
+        //pushed, or one with the same ROM and settings.
+        bool Seek(uint64_t frame, Chip8& chip8);
+
+        bool Empty() const { return entries.empty(); }
+
+        uint64_t OldestFrame() const { return first_frame; }
+
+        uint64_t NewestFrame() const { return first_frame + entries.size() - 1; }
+
+        std::size_t BytesUsed() const;
+
+    private:
+        struct Entry {
+            std::size_t offset;
+            uint32_t size;
+            bool keyframe;
+        };
+
+        std::vector<uint8_t> ring;
+        std::size_t tail {};
+        std::deque<Entry> entries;
+        uint64_t first_frame {};
+        unsigned int keyframe_interval;
+        unsigned int since_keyframe {};
+
+        //The keyframe deltas are taken against, and the scratch states and
+        //encoding buffer reused by every Push and Seek
+        Chip8::Snapshot key {};
+        Chip8::Snapshot current {};
+        std::vector<uint8_t> scratch;
+
+        void drop_oldest();
+
+        std::size_t reserve(std::size_t size);
+
+        void decode(Entry const& entry, Chip8::Snapshot const& base, Chip8::Snapshot& out) const;
+};
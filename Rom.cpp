@@ -0,0 +1,157 @@
+#include "Rom.h"
+#include "Chip8.h"
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+char const* RomErrorString(RomError error)
+{
+    switch(error)
+    {
+        case RomError::None: return "ok";
+        case RomError::NotFound: return "file not found or unreadable";
+        case RomError::Empty: return "ROM is empty";
+        case RomError::TooLarge: return "ROM does not fit in memory";
+    }
+    return "unknown error";
+}
+
+Rom::~Rom()
+{
+#ifndef _WIN32
+    if(mapping) {
+        munmap(mapping, mapping_size);
+    }
+#endif
+}
+
+RomCache& RomCache::Global()
+{
+    static RomCache cache;
+    return cache;
+}
+
+static RomError check_size(std::size_t size)
+{
+    if(size == 0) {
+        return RomError::Empty;
+    }
+    if(size > MAX_ROM_SIZE) {
+        return RomError::TooLarge;
+    }
+    return RomError::None;
+}
+
+static bool same_contents(Rom const& rom, uint8_t const* data, std::size_t size)
+{
+    return rom.Size() == size && std::memcmp(rom.Data(), data, size) == 0;
+}
+
+std::shared_ptr<Rom const> RomCache::intern(std::shared_ptr<Rom> rom)
+{
+    rom->hash = Chip8::HashBytes(rom->data, rom->size);
+
+    std::shared_ptr<Rom const>& slot = by_hash[rom->hash];
+    if(!slot) {
+        slot = rom;
+    }
+    //A hash collision keeps the new ROM out of the cache rather than alias it
+    return same_contents(*slot, rom->data, rom->size) ? slot : rom;
+}
+
+RomError RomCache::Load(char const* path, std::shared_ptr<Rom const>& rom)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto cached = by_path.find(path);
+    if(cached != by_path.end())
+    {
+        rom = cached->second;
+        return RomError::None;
+    }
+
+    std::shared_ptr<Rom> loaded(new Rom());
+
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open()) {
+        return RomError::NotFound;
+    }
+    loaded->owned.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    loaded->data = loaded->owned.data();
+    loaded->size = loaded->owned.size();
+
+    RomError error = check_size(loaded->size);
+    if(error != RomError::None) {
+        return error;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return RomError::NotFound;
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        close(fd);
+        return RomError::NotFound;
+    }
+
+    std::size_t size = static_cast<std::size_t>(info.st_size);
+    RomError error = check_size(size);
+    if(error != RomError::None)
+    {
+        close(fd);
+        return error;
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) {
+        return RomError::NotFound;
+    }
+
+    loaded->mapping = mapping;
+    loaded->mapping_size = size;
+    loaded->data = static_cast<uint8_t const*>(mapping);
+    loaded->size = size;
+#endif
+
+    rom = intern(loaded);
+    by_path[path] = rom;
+    return RomError::None;
+}
+
+RomError RomCache::Load(uint8_t const* data, std::size_t size, std::shared_ptr<Rom const>& rom)
+{
+    RomError error = check_size(size);
+    if(error != RomError::None) {
+        return error;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto cached = by_hash.find(Chip8::HashBytes(data, size));
+    if(cached != by_hash.end() && same_contents(*cached->second, data, size))
+    {
+        rom = cached->second;
+        return RomError::None;
+    }
+
+    std::shared_ptr<Rom> copy(new Rom());
+    copy->owned.assign(data, data + size);
+    copy->data = copy->owned.data();
+    copy->size = size;
+
+    rom = intern(copy);
+    return RomError::None;
+}
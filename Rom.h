@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class RomError {
+    None,
+    NotFound,   //File missing or unreadable
+    Empty,
+    TooLarge    //Does not fit between START_ADD and the end of memory
+};
+
+char const* RomErrorString(RomError error);
+
+//Immutable ROM contents, either a read-only mapping of the file or a copy
+//of caller-provided bytes
+class Rom {
+    public:
+        ~Rom();
+
+        Rom(Rom const&) = delete;
+        Rom& operator=(Rom const&) = delete;
+
+        uint8_t const* Data() const { return data; }
+
+        std::size_t Size() const { return size; }
+
+        //Content hash, also what Chip8::GetRomHash reports once loaded
+        uint64_t Hash() const { return hash; }
+
+    private:
+        friend class RomCache;
+
+        Rom() = default;
+
+        uint8_t const* data {};
+        std::size_t size {};
+        uint64_t hash {};
+
+        void* mapping {};
+        std::size_t mapping_size {};
+        std::vector<uint8_t> owned;
+};
+
+//Process-wide ROM cache. Each path is mapped once, and ROMs with identical
+//contents share a single Rom no matter which path or buffer they came from.
+class RomCache {
+    public:
+        static RomCache& Global();
+
+        RomError Load(char const* path, std::shared_ptr<Rom const>& rom);
+
+        RomError Load(uint8_t const* data, std::size_t size, std::shared_ptr<Rom const>& rom);
+
+    private:
+        std::shared_ptr<Rom const> intern(std::shared_ptr<Rom> rom);
+
+        std::mutex lock;
+        std::map<std::string, std::shared_ptr<Rom const>> by_path;
+        std::map<uint64_t, std::shared_ptr<Rom const>> by_hash;
+};
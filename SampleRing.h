@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+//Single-producer single-consumer FIFO of samples without locks or waiting.
+//All storage is allocated up front, so the consumer can be an audio
+//callback. Each side owns one index and only reads the other's.
+template<typename T>
+class SampleRing {
+    public:
+        //capacity is rounded up to a power of two
+        explicit SampleRing(std::size_t capacity)
+        {
+            std::size_t size = 1;
+            while(size < capacity) {
+                size <<= 1;
+            }
+            mask = size - 1;
+            samples.reset(new T[size]());
+        }
+
+        //Producer side: copies as many samples as fit, returns how many
+        std::size_t Push(T const* data, std::size_t count)
+        {
+            std::size_t write = tail.load(std::memory_order_relaxed);
+            std::size_t read = head.load(std::memory_order_acquire);
+            std::size_t space = mask + 1 - (write - read);
+            if(count > space) {
+                count = space;
+            }
+
+            for(std::size_t i = 0; i < count; i++) {
+                samples[(write + i) & mask] = data[i];
+            }
+            tail.store(write + count, std::memory_order_release);
+            return count;
+        }
+
+        //Consumer side: takes up to count samples, returns how many
+        std::size_t Pop(T* data, std::size_t count)
+        {
+            std::size_t read = head.load(std::memory_order_relaxed);
+            std::size_t write = tail.load(std::memory_order_acquire);
+            if(count > write - read) {
+                count = write - read;
+            }
+
+            for(std::size_t i = 0; i < count; i++) {
+                data[i] = samples[(read + i) & mask];
+            }
+            head.store(read + count, std::memory_order_release);
+            return count;
+        }
+
+        //Exact on the consumer side, an upper bound on the producer side
+        std::size_t Size() const
+        {
+            return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+        }
+
+    private:
+        std::unique_ptr<T[]> samples;
+        std::size_t mask;
+
+        alignas(64) std::atomic<std::size_t> head {0};
+        alignas(64) std::atomic<std::size_t> tail {0};
+};
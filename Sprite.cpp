@@ -0,0 +1,79 @@
+#include "Sprite.h"
+
+static const unsigned int SCREEN_ROWS = 32;
+static const unsigned int SCREEN_COLUMNS = 64;
+
+bool DrawSprite(uint64_t* screen, uint8_t const* sprite, unsigned int height,
+                unsigned int x, unsigned int y, bool wrap, uint32_t& dirtyRows)
+{
+    uint64_t collision = 0;
+
+    for(unsigned int row = 0; row < height; row++)
+    {
+        unsigned int screenRow = y + row;
+        if(screenRow >= SCREEN_ROWS)
+        {
+            if(!wrap) {
+                break;
+            }
+            screenRow -= SCREEN_ROWS;
+        }
+
+        uint64_t bits = static_cast<uint64_t>(sprite[row]) << 56u;
+        uint64_t mask = bits >> x;
+        if(wrap && x != 0)
+        {
+            mask |= bits << (SCREEN_COLUMNS - x);
+        }
+
+        collision |= screen[screenRow] & mask;
+        screen[screenRow] ^= mask;
+        dirtyRows |= 1u << screenRow;
+    }
+
+    return collision != 0;
+}
+
+bool DrawSpritePerPixel(uint64_t* screen, uint8_t const* sprite, unsigned int height,
+                        unsigned int x, unsigned int y, bool wrap, uint32_t& dirtyRows)
+{
+    bool collision = false;
+
+    for(unsigned int row = 0; row < height; row++)
+    {
+        unsigned int screenRow = y + row;
+        if(screenRow >= SCREEN_ROWS)
+        {
+            if(!wrap) {
+                break;
+            }
+            screenRow -= SCREEN_ROWS;
+        }
+
+        for(unsigned int col = 0; col < 8; col++)
+        {
+            unsigned int screenCol = x + col;
+            if(screenCol >= SCREEN_COLUMNS)
+            {
+                if(!wrap) {
+                    break;
+                }
+                screenCol -= SCREEN_COLUMNS;
+            }
+
+            if(!(sprite[row] & (0x80u >> col))) {
+                continue;
+            }
+
+            uint64_t pixel = 1ull << (63u - screenCol);
+            if(screen[screenRow] & pixel) {
+                collision = true;
+            }
+            screen[screenRow] ^= pixel;
+        }
+
+        dirtyRows |= 1u << screenRow;
+    }
+
+    return collision;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+
+//Sprite kernels for a 1-bit screen of 32 rows, bit 63 being the leftmost
+//column. Both XOR an 8-pixel-wide sprite of height rows in at (x, y), which
+//must already be reduced to 0-63 and 0-31. Pixels past the right or bottom
+//edge are dropped, or wrap around when wrap is set. Touched rows are added to
+//dirtyRows. Returns true when a lit pixel was switched off.
+
+//Shifts each sprite byte into a 64-bit row mask and XORs a whole row at once
+bool DrawSprite(uint64_t* screen, uint8_t const* sprite, unsigned int height,
+                unsigned int x, unsigned int y, bool wrap, uint32_t& dirtyRows);
+
+//Pixel-at-a-time reference the row kernel is checked and measured against
+bool DrawSpritePerPixel(uint64_t* screen, uint8_t const* sprite, unsigned int height,
+                        unsigned int x, unsigned int y, bool wrap, uint32_t& dirtyRows);
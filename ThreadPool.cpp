@@ -0,0 +1,114 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+    : queues(threadCount > 0 ? threadCount : 1)
+{
+    for(unsigned int i = 0; i < queues.size(); i++)
+    {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        stopping = true;
+    }
+    work_ready.notify_all();
+
+    for(std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::Submit(Task task)
+{
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        Queue& queue = queues[next_queue];
+        next_queue = (next_queue + 1) % queues.size();
+
+        {
+            std::lock_guard<std::mutex> queueGuard(queue.lock);
+            queue.tasks.push_back(std::move(task));
+        }
+
+        pending++;
+        queued++;
+    }
+    work_ready.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> guard(state_lock);
+    work_done.wait(guard, [this] { return pending == 0; });
+}
+
+bool ThreadPool::pop_local(unsigned int index, Task& task)
+{
+    Queue& queue = queues[index];
+    std::lock_guard<std::mutex> guard(queue.lock);
+
+    if(queue.tasks.empty())
+    {
+        return false;
+    }
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(unsigned int thief, Task& task)
+{
+    for(std::size_t offset = 1; offset < queues.size(); offset++)
+    {
+        Queue& victim = queues[(thief + offset) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+
+        if(!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::worker_loop(unsigned int index)
+{
+    for(;;)
+    {
+        Task task;
+
+        if(pop_local(index, task) || steal(index, task))
+        {
+            {
+                std::lock_guard<std::mutex> guard(state_lock);
+                queued--;
+            }
+
+            task(index);
+
+            std::lock_guard<std::mutex> guard(state_lock);
+            if(--pending == 0)
+            {
+                work_done.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(state_lock);
+        work_ready.wait(guard, [this] { return stopping || queued > 0; });
+
+        if(stopping && queued == 0)
+        {
+            return;
+        }
+    }
+}
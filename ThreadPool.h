@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Fixed-size pool where every worker owns a deque. Workers pop their own
+//work from the back and steal from the front of other workers' deques
+//when they run dry.
+class ThreadPool {
+    public:
+        typedef std::function<void(unsigned int worker)> Task;
+
+        explicit ThreadPool(unsigned int threadCount);
+        ~ThreadPool();
+
+        void Submit(Task task);
+
+        //Blocks until every submitted task has finished
+        void Wait();
+
+        unsigned int Size() const { return static_cast<unsigned int>(workers.size()); }
+
+    private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        void worker_loop(unsigned int index);
+        bool pop_local(unsigned int index, Task& task);
+        bool steal(unsigned int thief, Task& task);
+
+        std::vector<std::thread> workers;
+        std::vector<Queue> queues;
+
+        std::mutex state_lock;
+        std::condition_variable work_ready;
+        std::condition_variable work_done;
+        std::size_t pending {};
+        std::size_t queued {};
+        std::size_t next_queue {};
+        bool stopping {};
+};
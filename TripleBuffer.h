@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+//Single-producer single-consumer handoff of the newest value, without
+//locks or waiting. The producer fills its back slot and swaps it with the
+//shared middle slot; the consumer swaps the middle slot for its front slot
+//only when a newer value was published, so stale values are skipped and
+//neither side ever touches the slot the other one owns.
+template<typename T>
+class TripleBuffer {
+    public:
+        //Slot the producer may write into
+        T& Back() { return slots[back]; }
+
+        void Publish()
+        {
+            back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+        }
+
+        //Makes the newest published value the front slot; false when
+        //nothing was published since the last call
+        bool Acquire()
+        {
+            if(!(middle.load(std::memory_order_relaxed) & FRESH)) {
+                return false;
+            }
+            front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+
+        T const& Front() const { return slots[front]; }
+
+    private:
+        static const uint8_t INDEX = 0x3;
+        static const uint8_t FRESH = 0x4;
+
+        T slots[3] {};
+
+        //Each index is owned by one side; only middle is shared, and each
+        //gets its own cache line so the two threads never false-share
+        alignas(64) uint8_t back {0};
+        alignas(64) std::atomic<uint8_t> middle {1};
+        alignas(64) uint8_t front {2};
+};
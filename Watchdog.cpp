@@ -0,0 +1,66 @@
+#include "Watchdog.h"
+
+char const* TerminationString(Termination reason)
+{
+    switch(reason)
+    {
+        case Termination::Running: return "running";
+        case Termination::StackOverflow: return "stack overflow";
+        case Termination::StackUnderflow: return "stack underflow";
+        case Termination::InvalidOpcode: return "invalid opcode";
+        case Termination::StateCycle: return "state cycle";
+    }
+    return "unknown";
+}
+
+Termination Watchdog::Check(Chip8 const& chip8)
+{
+    if(termination != Termination::Running) {
+        return termination;
+    }
+
+    switch(chip8.GetFault())
+    {
+        case Fault::StackOverflow: return termination = Termination::StackOverflow;
+        case Fault::StackUnderflow: return termination = Termination::StackUnderflow;
+        case Fault::None: break;
+    }
+
+    uint16_t address, opcode;
+    if(chip8.GetInvalidOpcode(address, opcode)) {
+        return termination = Termination::InvalidOpcode;
+    }
+
+    uint64_t hash = chip8.GetStateHash();
+    if(has_saved && hash == saved_hash && chip8.StateEquals(*saved))
+    {
+        cycle_length = steps;
+        return termination = Termination::StateCycle;
+    }
+
+    //Moving the saved state forward at doubling intervals means it
+    //eventually sits inside any cycle with an interval longer than it
+    if(steps == power)
+    {
+        if(saved) {
+            *saved = chip8;
+        }
+        else {
+            saved = std::make_unique<Chip8>(chip8);
+        }
+        has_saved = true;
+        saved_hash = hash;
+        power *= 2;
+        steps = 0;
+    }
+    steps++;
+
+    return Termination::Running;
+}
+
+void Watchdog::Reset()
+{
+    has_saved = false;
+    power = 1;
+    steps = 1;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "Chip8.h"
+#include <cstdint>
+#include <memory>
+
+//Why Watchdog gave up on a machine
+enum class Termination : uint8_t {
+    Running,
+    StackOverflow,   //Fault::StackOverflow
+    StackUnderflow,  //Fault::StackUnderflow
+    InvalidOpcode,   //Ran an opcode with no handler
+    StateCycle       //Came back to the exact state of an earlier check
+};
+
+char const* TerminationString(Termination reason);
+
+//Decides that a machine has hung, from checks made at frame boundaries.
+//Faults and invalid opcodes are reported by the first check after them.
+//Repeated states are found with Brent's algorithm over GetStateHash() and
+//confirmed with StateEquals, within about twice the length of the cycle
+//plus the frames before it. A repeat only means a hang while the keys stay
+//the same, so Reset() whenever they change.
+class Watchdog {
+    public:
+        //Returns Termination::Running until a check finds a reason, and
+        //that reason from then on
+        Termination Check(Chip8 const& chip8);
+
+        Termination GetTermination() const { return termination; }
+
+        //Checks between the two visits of the repeated state
+        uint64_t GetCycleLength() const { return cycle_length; }
+
+        //Forgets the states seen so far
+        void Reset();
+
+    private:
+        Termination termination {Termination::Running};
+
+        //The state Brent's algorithm compares against, taken when steps
+        //reaches power
+        std::unique_ptr<Chip8> saved;
+        bool has_saved {};
+        uint64_t saved_hash {};
+        uint64_t power {1};
+        uint64_t steps {1};
+
+        uint64_t cycle_length {};
+};
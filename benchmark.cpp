@@ -0,0 +1,324 @@
+#include "Chip8.h"
+#include "Rewind.h"
+#include "Sprite.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+
+
+//ALU loop: every 8xy* arithmetic, logic and shift form with a skip
+static const uint8_t alu_rom[] =
+{
+    0x60, 0x00, // 200: LD V0, 0
+    0x61, 0x01, // 202: LD V1, 1
+    0x80, 0x14, // 204: ADD V0, V1
+    0x82, 0x13, // 206: XOR V2, V1
+    0x83, 0x11, // 208: OR V3, V1
+    0x84, 0x36, // 20A: SHR V4
+    0x85, 0x15, // 20C: SUB V5, V1
+    0x86, 0x17, // 20E: SUBN V6, V1
+    0x87, 0x1E, // 210: SHL V7
+    0x30, 0x00, // 212: SE V0, 0
+    0x12, 0x04, // 214: JP 204
+    0x12, 0x00  // 216: JP 200
+};
+
+//Draw loop: font glyphs stamped across the screen, wrapping at the edges
+static const uint8_t draw_rom[] =
+{
+    0x60, 0x00, // 200: LD V0, 0
+    0x61, 0x00, // 202: LD V1, 0
+    0xF2, 0x29, // 204: LD F, V2
+    0xD0, 0x15, // 206: DRW V0, V1, 5
+    0x70, 0x05, // 208: ADD V0, 5
+    0x71, 0x03, // 20A: ADD V1, 3
+    0x72, 0x01, // 20C: ADD V2, 1
+    0x12, 0x04  // 20E: JP 204
+};
+
+//Call loop: nested subroutines, so half of the work is 2nnn and 00EE
+static const uint8_t call_rom[] =
+{
+    0x22, 0x08, // 200: CALL 208
+    0x22, 0x0C, // 202: CALL 20C
+    0x12, 0x00, // 204: JP 200
+    0x00, 0x00, // 206:
+    0x70, 0x01, // 208: ADD V0, 1
+    0x00, 0xEE, // 20A: RET
+    0x22, 0x08, // 20C: CALL 208
+    0x00, 0xEE  // 20E: RET
+};
+
+//Memory loop: BCD and register stores that keep invalidating decoded slots
+static const uint8_t memory_rom[] =
+{
+    0xA3, 0x00, // 200: LD I, 300
+    0x70, 0x07, // 202: ADD V0, 7
+    0xF0, 0x33, // 204: LD B, V0
+    0xF2, 0x65, // 206: LD V2, [I]
+    0xF3, 0x55, // 208: LD [I], V3
+    0x12, 0x02  // 20A: JP 202
+};
+
+struct Workload
+{
+    char const* name;
+    uint8_t const* rom;
+    std::size_t size;
+};
+
+static const Workload workloads[] =
+{
+    {"alu", alu_rom, sizeof(alu_rom)},
+    {"draw", draw_rom, sizeof(draw_rom)},
+    {"call", call_rom, sizeof(call_rom)},
+    {"memory", memory_rom, sizeof(memory_rom)}
+};
+
+static const struct
+{
+    char const* name;
+    Engine engine;
+} engines[] =
+{
+    {"table", Engine::Table},
+    {"cached", Engine::Cached},
+    {"threaded", Engine::Threaded},
+    {"jit", Engine::Jit}
+};
+
+//Best of five runs, in seconds
+static double measure(Workload const& workload, uint64_t instructions, Engine engine)
+{
+    double best = 0.0;
+
+    for(int run = 0; run < 5; run++)
+    {
+        Chip8 chip8;
+        chip8.load_rom(workload.rom, workload.size);
+        chip8.SetEngine(engine);
+
+        auto start = std::chrono::steady_clock::now();
+        chip8.RunFor(instructions);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if(run == 0 || seconds < best)
+        {
+            best = seconds;
+        }
+    }
+
+    return best;
+}
+
+//Microseconds per displayed frame when each one also runs ahead frames
+//past it and rolls back, as the SDL frontend's --run-ahead does
+static double measure_run_ahead(Workload const& workload, unsigned int ahead, uint64_t frames)
+{
+    static Chip8::Snapshot snapshot;
+
+    Chip8 chip8;
+    chip8.load_rom(workload.rom, workload.size);
+    chip8.SetEngine(Engine::Threaded);
+
+    auto start = std::chrono::steady_clock::now();
+    for(uint64_t frame = 0; frame < frames; frame++)
+    {
+        chip8.RunUntilFrame();
+
+        chip8.Capture(snapshot);
+        for(unsigned int i = 0; i < ahead; i++) {
+            chip8.RunUntilFrame();
+        }
+        chip8.Restore(snapshot);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return seconds * 1e6 / frames;
+}
+
+//Microseconds per Push and per Seek of a rewind buffer recording the workload
+//every frame with the default budget and keyframe interval
+static void measure_rewind(Workload const& workload, uint64_t frames, double& pushUs, double& seekUs)
+{
+    Chip8 chip8;
+    chip8.load_rom(workload.rom, workload.size);
+    chip8.SetEngine(Engine::Threaded);
+
+    RewindBuffer rewind(DEFAULT_REWIND_BUDGET);
+    double pushSeconds = 0;
+    for(uint64_t frame = 0; frame < frames; frame++)
+    {
+        chip8.RunUntilFrame();
+
+        auto start = std::chrono::steady_clock::now();
+        rewind.Push(chip8);
+        pushSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    //Walk backwards one frame at a time, as holding the rewind key does
+    uint64_t seeks = 0;
+    auto start = std::chrono::steady_clock::now();
+    while(rewind.NewestFrame() > rewind.OldestFrame() && seeks < frames)
+    {
+        rewind.Seek(rewind.NewestFrame() - 1, chip8);
+        seeks++;
+    }
+    double seekSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    pushUs = pushSeconds * 1e6 / frames;
+    seekUs = seeks > 0 ? seekSeconds * 1e6 / seeks : 0;
+}
+
+//Row kernel must agree with the per-pixel reference on every position,
+//height and edge mode, and both must handle the hand-checked edge cases
+static bool check_sprite_kernels()
+{
+    std::mt19937 rng(1234);
+    uint8_t sprite[15];
+
+    for(int trial = 0; trial < 64; trial++)
+    {
+        uint64_t base[32];
+        for(uint64_t& row : base) {
+            row = (static_cast<uint64_t>(rng()) << 32) | rng();
+        }
+        for(uint8_t& byte : sprite) {
+            byte = static_cast<uint8_t>(rng());
+        }
+
+        for(int wrap = 0; wrap < 2; wrap++)
+        for(unsigned int height = 0; height <= 15; height++)
+        for(unsigned int y = 0; y < 32; y++)
+        for(unsigned int x = 0; x < 64; x++)
+        {
+            uint64_t rowScreen[32], pixelScreen[32];
+            std::memcpy(rowScreen, base, sizeof(base));
+            std::memcpy(pixelScreen, base, sizeof(base));
+            uint32_t rowDirty = 0, pixelDirty = 0;
+
+            bool rowHit = DrawSprite(rowScreen, sprite, height, x, y, wrap != 0, rowDirty);
+            bool pixelHit = DrawSpritePerPixel(pixelScreen, sprite, height, x, y, wrap != 0, pixelDirty);
+
+            if(rowHit != pixelHit || rowDirty != pixelDirty
+               || std::memcmp(rowScreen, pixelScreen, sizeof(rowScreen)) != 0)
+            {
+                std::cerr << "sprite kernels disagree at x=" << x << " y=" << y
+                          << " height=" << height << " wrap=" << wrap << "\n";
+                return false;
+            }
+        }
+    }
+
+    uint64_t screen[32] {};
+    uint32_t dirty = 0;
+    uint8_t full = 0xFF;
+
+    //Drawing onto a blank screen never collides, drawing again erases and does
+    bool ok = !DrawSprite(screen, &full, 1, 0, 0, false, dirty)
+        && screen[0] == 0xFF00000000000000ull
+        && DrawSprite(screen, &full, 1, 0, 0, false, dirty)
+        && screen[0] == 0;
+
+    //Right and bottom edges clip, or wrap to column 0 and row 0
+    ok = ok && !DrawSprite(screen, &full, 1, 60, 0, false, dirty)
+        && screen[0] == 0x000000000000000Full;
+    screen[0] = 0;
+    ok = ok && !DrawSprite(screen, &full, 1, 60, 0, true, dirty)
+        && screen[0] == 0xF00000000000000Full;
+    screen[0] = 0;
+
+    uint8_t column[2] = {0x80, 0x80};
+    ok = ok && !DrawSprite(screen, column, 2, 0, 31, false, dirty)
+        && screen[31] == 0x8000000000000000ull && screen[0] == 0;
+    screen[31] = 0;
+    ok = ok && !DrawSprite(screen, column, 2, 0, 31, true, dirty)
+        && screen[31] == 0x8000000000000000ull && screen[0] == 0x8000000000000000ull;
+
+    if(!ok) {
+        std::cerr << "sprite kernels fail the collision/clipping cases\n";
+    }
+    return ok;
+}
+
+//Keeps the draws observable so they are not optimised away
+static volatile uint64_t sprite_sink;
+
+template <typename Kernel>
+static double measure_sprites(Kernel kernel, uint64_t draws)
+{
+    static const uint8_t sprite[15] = {0x3C, 0x42, 0x81, 0xA5, 0x81, 0x99, 0x42, 0x3C,
+                                       0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF};
+    uint64_t screen[32] {};
+    uint32_t dirty = 0;
+    unsigned int hits = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for(uint64_t i = 0; i < draws; i++)
+    {
+        hits += kernel(screen, sprite, 15, (i * 7) & 63, (i * 3) & 31, false, dirty);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    sprite_sink = hits + screen[0];
+
+    return seconds * 1e9 / draws;
+}
+
+//Emits one JSON document on stdout so runs can be diffed between builds.
+//FPS is emulated 60 Hz frames per host second at the default clock rate.
+int main(int argc, char** argv)
+{
+    uint64_t instructions = argc > 1 ? std::stoull(argv[1]) : 20000000;
+    double cyclesPerFrame = static_cast<double>(DEFAULT_CLOCK_RATE) / TIMER_RATE;
+
+    if(!check_sprite_kernels())
+    {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "{\n  \"instructions\": " << instructions
+              << ",\n  \"clock_rate\": " << DEFAULT_CLOCK_RATE
+              << ",\n  \"workloads\": [";
+
+    bool first = true;
+    for(Workload const& workload : workloads)
+    {
+        for(auto const& entry : engines)
+        {
+            double seconds = measure(workload, instructions, entry.engine);
+            double ips = instructions / seconds;
+
+            std::cout << (first ? "\n" : ",\n")
+                      << "    {\"rom\": \"" << workload.name << "\", \"engine\": \"" << entry.name
+                      << "\", \"ips\": " << ips
+                      << ", \"ns_per_instruction\": " << seconds * 1e9 / instructions
+                      << ", \"fps\": " << ips / cyclesPerFrame << "}";
+            first = false;
+        }
+    }
+
+    double perPixel = measure_sprites(DrawSpritePerPixel, instructions / 4);
+    double perRow = measure_sprites(DrawSprite, instructions / 4);
+
+    std::cout << "\n  ],\n  \"sprites\": {\"per_pixel_ns\": " << perPixel
+              << ", \"row_ns\": " << perRow << "},\n  \"run_ahead\": [";
+
+    //The draw loop at the default clock rate; a frame budget is 16.7 ms
+    uint64_t frames = instructions / 100;
+    for(unsigned int ahead = 0; ahead <= 3; ahead++)
+    {
+        std::cout << (ahead == 0 ? "\n" : ",\n") << "    {\"frames\": " << ahead
+                  << ", \"us_per_frame\": " << measure_run_ahead(workloads[1], ahead, frames) << "}";
+    }
+
+    double pushUs, seekUs;
+    measure_rewind(workloads[1], frames, pushUs, seekUs);
+    std::cout << "\n  ],\n  \"rewind\": {\"push_us\": " << pushUs << ", \"seek_us\": " << seekUs << "}\n}\n";
+
+    return 0;
+}
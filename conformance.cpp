@@ -0,0 +1,252 @@
+#include "Chip8.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Manifest lines, one case each; blank lines and text after '#' are ignored:
+
+  <rom> <vip|chip48|schip> <frames> <screen hash in hex, or - if unknown>
+
+ROM paths are relative to the manifest. Every case runs on the reference
+interpreter for the given number of 60 Hz frames with no keys held, and
+GetScreenHash() has to match the golden value. The optimised engines then
+run the same case and have to end in exactly the reference state.
+*/
+
+struct Case
+{
+    std::string path;   //As written in the manifest
+    std::string rom;
+    std::string profileName;
+    QuirkProfile profile;
+    uint64_t frames;
+    bool known;
+    uint64_t golden;
+
+    uint64_t hash;
+    bool passed;
+};
+
+static bool parse_manifest(char const* path, std::vector<Case>& cases)
+{
+    std::ifstream file(path);
+    if(!file) {
+        return false;
+    }
+
+    std::string manifest = path;
+    std::string directory = manifest.substr(0, manifest.find_last_of('/') + 1);
+
+    std::string line;
+    while(std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        Case entry {};
+        std::string golden;
+        if(!(fields >> entry.path)) {
+            continue;
+        }
+        if(!(fields >> entry.profileName >> entry.frames >> golden)
+           || !ParseQuirkProfile(entry.profileName.c_str(), entry.profile))
+        {
+            std::cerr << path << ": malformed line: " << line << "\n";
+            return false;
+        }
+
+        entry.rom = entry.path[0] == '/' ? entry.path : directory + entry.path;
+        entry.known = golden != "-";
+        entry.golden = entry.known ? std::stoull(golden, nullptr, 16) : 0;
+
+        cases.push_back(entry);
+    }
+    return true;
+}
+
+static void run_frames(Chip8& chip8, uint64_t frames)
+{
+    for(uint64_t frame = 0; frame < frames; frame++) {
+        chip8.RunUntilFrame();
+    }
+}
+
+//Reference hash first, then every other engine against the reference state
+static bool run_case(Case& entry)
+{
+    Chip8 loaded;
+    RomError error = loaded.load_rom(entry.rom.c_str());
+    if(error != RomError::None)
+    {
+        std::cerr << entry.rom << ": " << RomErrorString(error) << "\n";
+        return false;
+    }
+    loaded.SetQuirks(entry.profile);
+
+    Chip8 reference = loaded.Fork();
+    run_frames(reference, entry.frames);
+    entry.hash = reference.GetScreenHash();
+
+    bool ok = true;
+    if(entry.known && entry.hash != entry.golden)
+    {
+        std::cerr << entry.rom << " (" << entry.profileName << ", " << entry.frames
+                  << " frames): screen hash " << std::hex << entry.hash << ", expected "
+                  << entry.golden << std::dec << "\n";
+        ok = false;
+    }
+
+    static const Engine optimised[] = {Engine::Cached, Engine::Threaded, Engine::Compiled, Engine::Jit};
+    static char const* const names[] = {"cached", "threaded", "compiled", "jit"};
+
+    for(std::size_t i = 0; i < sizeof(optimised) / sizeof(optimised[0]); i++)
+    {
+        Chip8 candidate = loaded.Fork();
+        candidate.SetEngine(optimised[i]);
+        run_frames(candidate, entry.frames);
+
+        if(!candidate.StateEquals(reference))
+        {
+            std::cerr << entry.rom << " (" << entry.profileName << "): " << names[i]
+                      << " engine does not match the reference interpreter\n";
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+//LoadState has to refuse a stack pointer past the end of the stack, which
+//2nnn and 00EE would otherwise index with. Restore takes a snapshot as is,
+//so it can put a corrupt stack pointer into a state file.
+static bool check_state_validation()
+{
+    static const uint8_t rom[] = {0x12, 0x00};
+
+    Chip8 corrupt;
+    corrupt.load_rom(rom, sizeof(rom));
+
+    Chip8::Snapshot snapshot;
+    corrupt.Capture(snapshot);
+    snapshot.stack_pointer = 0xFF;
+    corrupt.Restore(snapshot);
+
+    uint8_t state[Chip8::MAX_STATE_SIZE];
+    std::size_t size = corrupt.SaveState(state, sizeof(state));
+
+    Chip8 loaded;
+    loaded.load_rom(rom, sizeof(rom));
+    return size != 0 && !loaded.LoadState(state, size);
+}
+
+//A machine that finished an Fx0A wait comes back equal from a save
+static bool check_state_round_trip()
+{
+    static const uint8_t rom[] = {0xF5, 0x0A, 0x12, 0x02};
+
+    Chip8 original;
+    original.load_rom(rom, sizeof(rom));
+    original.RunFor(3);
+    original.SetKeys(1);
+    original.RunFor(3);
+
+    uint8_t state[Chip8::MAX_STATE_SIZE];
+    std::size_t size = original.SaveState(state, sizeof(state));
+
+    Chip8 loaded;
+    loaded.load_rom(rom, sizeof(rom));
+    return size != 0 && loaded.LoadState(state, size) && loaded.StateEquals(original);
+}
+
+static void usage(char const* program)
+{
+    std::cerr << "Usage: " << program << " [--threads N] [--update] <manifest> [manifest...]\n";
+    std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int threads = std::thread::hardware_concurrency();
+    bool update = false;
+    std::vector<Case> cases;
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if(arg == "--threads" && i + 1 < argc)
+        {
+            threads = std::stoul(argv[++i]);
+        }
+        else if(arg == "--update")
+        {
+            update = true;
+        }
+        else if(!parse_manifest(argv[i], cases))
+        {
+            std::cerr << "cannot read manifest " << argv[i] << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(cases.empty())
+    {
+        usage(argv[0]);
+    }
+
+    if(!check_state_validation())
+    {
+        std::cerr << "LoadState accepted a stack pointer past the end of the stack\n";
+        return EXIT_FAILURE;
+    }
+    if(!check_state_round_trip())
+    {
+        std::cerr << "a saved and loaded state does not equal the original\n";
+        return EXIT_FAILURE;
+    }
+
+    ThreadPool pool(threads);
+    std::atomic<unsigned int> failures {0};
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(Case& entry : cases)
+    {
+        pool.Submit([&entry, &failures](unsigned int) {
+            entry.passed = run_case(entry);
+            if(!entry.passed) {
+                failures++;
+            }
+        });
+    }
+
+    pool.Wait();
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    //--update prints the manifest back with the reference hashes filled in
+    if(update)
+    {
+        for(Case const& entry : cases)
+        {
+            std::cout << entry.path << " " << entry.profileName << " " << entry.frames << " "
+                      << std::hex << std::setw(16) << std::setfill('0') << entry.hash
+                      << std::dec << std::setfill(' ') << "\n";
+        }
+    }
+
+    std::cerr << cases.size() - failures << "/" << cases.size() << " cases passed in "
+              << wall << " s (" << (wall > 0 ? cases.size() / wall : 0.0) << " cases/s)\n";
+
+    return failures == 0 ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,533 @@
+#include "Beeper.h"
+#include "Chip8.h"
+#include "Chip8Batch.h"
+#include "Jit.h"
+#include "Movie.h"
+#include "NullFrontend.h"
+#include "ThreadPool.h"
+#include "Watchdog.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct WorkerStats
+{
+    uint64_t instructions {};
+    uint64_t jobs {};
+    double seconds {};
+    uint64_t vector_instructions {};
+    uint64_t skipped_cycles {};
+    uint64_t stopped {};
+};
+
+static bool parse_engine(std::string const& name, Engine& engine)
+{
+    if(name == "table") {
+        engine = Engine::Table;
+    }
+    else if(name == "cached") {
+        engine = Engine::Cached;
+    }
+    else if(name == "threaded") {
+        engine = Engine::Threaded;
+    }
+    else if(name == "compiled") {
+        engine = Engine::Compiled;
+    }
+    else if(name == "jit") {
+        engine = Engine::Jit;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+//Runs cycles instructions. With a movie the run goes a frame at a time
+//and each frame gets the recorded keypad state. With audio, each frame's
+//beeper output is rendered into it. With verify, a copy on the reference
+//interpreter runs in lockstep and the first chunk after which their
+//states differ is reported. With a watchdog, the run ends at the first
+//frame boundary where it finds the machine hung.
+static bool run_job(Chip8& chip8, uint64_t cycles, Movie const* movie, NullFrontend* audio, bool verify,
+                    Watchdog* watchdog)
+{
+    const uint64_t CHUNK = 1024;
+
+    if(!movie && !audio && !verify && !watchdog)
+    {
+        chip8.RunFor(cycles);
+        return true;
+    }
+
+    //The reference runs every instruction, which also checks idle skipping
+    Chip8 reference = chip8;
+    reference.SetEngine(Engine::Table);
+    reference.SetIdleSkip(false);
+
+    BeeperSynth synth;
+    float samples[SAMPLES_PER_FRAME];
+
+    std::size_t frame = 0;
+    for(uint64_t done = 0; done < cycles;)
+    {
+        uint64_t count = cycles - done < CHUNK ? cycles - done : CHUNK;
+        bool endsFrame = false;
+
+        if(movie || audio || watchdog)
+        {
+            uint64_t untilTick = chip8.CyclesUntilTimerTick();
+            if(count > untilTick) {
+                count = untilTick;
+            }
+            endsFrame = count == untilTick;
+        }
+
+        if(movie)
+        {
+            uint16_t keys = 0;
+            movie->Apply(frame, keys);
+            chip8.SetKeys(keys);
+            reference.SetKeys(keys);
+
+            //Until the movie runs out, its input can still break a repeat
+            if(watchdog && frame < movie->FrameCount()) {
+                watchdog->Reset();
+            }
+        }
+        if(endsFrame) {
+            frame++;
+        }
+
+        chip8.RunFor(count);
+
+        if(audio && endsFrame)
+        {
+            synth.Render(chip8, samples, SAMPLES_PER_FRAME);
+            audio->QueueAudio(samples, SAMPLES_PER_FRAME);
+        }
+
+        if(verify)
+        {
+            reference.RunFor(count);
+
+            if(!chip8.StateEquals(reference))
+            {
+                std::cerr << "divergence from reference between cycles " << done
+                          << " and " << done + count << "\n";
+                return false;
+            }
+        }
+
+        done += count;
+
+        if(watchdog && endsFrame && watchdog->Check(chip8) != Termination::Running) {
+            break;
+        }
+    }
+
+    return true;
+}
+
+//One line on why the watchdog stopped a machine
+static std::string describe_stop(char const* rom, unsigned int instance, Chip8 const& chip8, Watchdog const& watchdog)
+{
+    std::ostringstream line;
+    line << rom << " instance " << instance << ": stopped at cycle " << chip8.GetCycleCount() << ", "
+         << TerminationString(watchdog.GetTermination()) << std::hex;
+
+    uint16_t address, opcode;
+    switch(watchdog.GetTermination())
+    {
+        case Termination::InvalidOpcode:
+            chip8.GetInvalidOpcode(address, opcode);
+            line << " 0x" << opcode << " at 0x" << address;
+            break;
+        case Termination::StateCycle:
+            line << std::dec << " of " << watchdog.GetCycleLength() << " frames"
+                 << (chip8.IsWaitingForKey() ? " waiting for a key" : "");
+            break;
+        default:
+            line << " at 0x" << chip8.GetProgramCounter();
+            break;
+    }
+
+    line << "\n";
+    return line.str();
+}
+
+//Runs cycles instructions on every machine as lanes of one batch, a chunk
+//at a time so movie keys reach every lane at frame starts. With verify the
+//machines themselves are the reference: they run on the interpreter and
+//each lane is compared against its machine after every chunk.
+static bool run_batch(std::vector<Chip8>& machines, uint64_t cycles, Movie const* movie, bool verify,
+                      uint64_t& vectorInstructions)
+{
+    const uint64_t CHUNK = 1024;
+
+    auto batch = std::make_unique<Chip8Batch>(machines[0].GetQuirks(), machines[0].GetSpriteWrap(),
+                                              machines[0].GetClockRate());
+    for(std::size_t lane = 0; lane < machines.size(); lane++)
+    {
+        machines[lane].SetEngine(Engine::Table);
+        if(!batch->Load(lane, machines[lane])) {
+            return false;
+        }
+    }
+
+    Chip8 lane_state = machines[0];
+
+    std::size_t frame = 0;
+    for(uint64_t done = 0; done < cycles;)
+    {
+        uint64_t count = cycles - done < CHUNK ? cycles - done : CHUNK;
+
+        if(movie)
+        {
+            uint64_t untilTick = batch->CyclesUntilTimerTick();
+            if(count > untilTick) {
+                count = untilTick;
+            }
+
+            uint16_t keys = 0;
+            movie->Apply(frame, keys);
+            for(std::size_t lane = 0; lane < machines.size(); lane++)
+            {
+                batch->SetKeys(lane, keys);
+                machines[lane].SetKeys(keys);
+            }
+            if(count == untilTick) {
+                frame++;
+            }
+        }
+
+        batch->RunFor(count);
+
+        if(verify)
+        {
+            for(std::size_t lane = 0; lane < machines.size(); lane++)
+            {
+                machines[lane].RunFor(count);
+                batch->Store(lane, lane_state);
+
+                if(!lane_state.StateEquals(machines[lane]))
+                {
+                    std::cerr << "lane " << lane << " diverges from reference between cycles " << done
+                              << " and " << done + count << "\n";
+                    return false;
+                }
+            }
+        }
+
+        done += count;
+    }
+
+    vectorInstructions += batch->GetVectorInstructions();
+    return true;
+}
+
+static void usage(char const* program)
+{
+    std::cerr << "Usage: " << program
+              << " [--threads N] [--instances N] [--engine table|cached|threaded|compiled|jit] [--batch] [--perf-map] [--hz N] [--seed N]"
+              << " [--movie FILE] [--verify] [--watchdog] [--quirks vip|chip48|schip] [--quirks-db FILE] [--wav FILE]"
+              << " <Cycles> <ROM> [ROM...]\n";
+    std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int threads = std::thread::hardware_concurrency();
+    unsigned int instances = 1;
+    Engine engine = Engine::Table;
+    uint32_t hz = DEFAULT_CLOCK_RATE;
+    uint64_t seed = DEFAULT_SEED;
+    char const* moviePath = nullptr;
+    bool verify = false;
+    bool batch = false;
+    bool useWatchdog = false;
+    QuirkProfile quirks = QuirkProfile::CosmacVip;
+    bool forceQuirks = false;
+    char const* wavPath = nullptr;
+    std::vector<char const*> positional;
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if(arg == "--threads" && i + 1 < argc)
+        {
+            threads = std::stoul(argv[++i]);
+        }
+        else if(arg == "--instances" && i + 1 < argc)
+        {
+            instances = std::stoul(argv[++i]);
+        }
+        else if(arg == "--engine" && i + 1 < argc)
+        {
+            if(!parse_engine(argv[++i], engine))
+            {
+                usage(argv[0]);
+            }
+        }
+        else if(arg == "--hz" && i + 1 < argc)
+        {
+            hz = std::stoul(argv[++i]);
+        }
+        else if(arg == "--seed" && i + 1 < argc)
+        {
+            seed = std::stoull(argv[++i]);
+        }
+        else if(arg == "--movie" && i + 1 < argc)
+        {
+            moviePath = argv[++i];
+        }
+        else if(arg == "--verify")
+        {
+            verify = true;
+        }
+        else if(arg == "--watchdog")
+        {
+            useWatchdog = true;
+        }
+        else if(arg == "--batch")
+        {
+            batch = true;
+        }
+        else if(arg == "--perf-map")
+        {
+            JitCode::EnablePerfMap();
+        }
+        else if(arg == "--quirks" && i + 1 < argc)
+        {
+            if(!ParseQuirkProfile(argv[++i], quirks))
+            {
+                usage(argv[0]);
+            }
+            forceQuirks = true;
+        }
+        else if(arg == "--wav" && i + 1 < argc)
+        {
+            wavPath = argv[++i];
+        }
+        else if(arg == "--quirks-db" && i + 1 < argc)
+        {
+            if(!QuirkDatabase::Global().Load(argv[++i]))
+            {
+                std::cerr << "cannot read quirk database " << argv[i] << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if(positional.size() < 2)
+    {
+        usage(argv[0]);
+    }
+
+    uint64_t cycles = std::stoull(positional[0]);
+    std::vector<char const*> roms(positional.begin() + 1, positional.end());
+
+    //A movie pins the seed and clock rate it was recorded with
+    Movie movie;
+    if(moviePath)
+    {
+        if(!movie.Load(moviePath))
+        {
+            std::cerr << "cannot read movie " << moviePath << "\n";
+            return EXIT_FAILURE;
+        }
+        seed = movie.GetSeed();
+        hz = movie.GetClockRate();
+    }
+    Movie const* playback = moviePath ? &movie : nullptr;
+
+    if(batch && wavPath)
+    {
+        std::cerr << "--wav needs a single machine and cannot be used with --batch\n";
+        return EXIT_FAILURE;
+    }
+    if(batch && useWatchdog)
+    {
+        std::cerr << "--watchdog needs the state hash of a Chip8 and cannot be used with --batch\n";
+        return EXIT_FAILURE;
+    }
+
+    ThreadPool pool(threads);
+    std::vector<WorkerStats> stats(pool.Size());
+    std::atomic<unsigned int> failures {0};
+
+    auto start = std::chrono::steady_clock::now();
+
+    //--batch runs the instances of each ROM as lanes, LANES per task
+    for(char const* rom : roms)
+    {
+        for(unsigned int first = 0; batch && first < instances; first += Chip8Batch::LANES)
+        {
+            unsigned int lanes = instances - first < Chip8Batch::LANES ? instances - first : Chip8Batch::LANES;
+
+            pool.Submit([rom, cycles, hz, seed, first, lanes, playback, verify, quirks, forceQuirks, &stats, &failures](unsigned int worker) {
+                auto jobStart = std::chrono::steady_clock::now();
+
+                std::vector<Chip8> machines;
+                machines.reserve(lanes);
+                for(unsigned int instance = first; instance < first + lanes; instance++)
+                {
+                    machines.emplace_back(playback ? seed : seed + instance);
+                    Chip8& chip8 = machines.back();
+
+                    RomError error = chip8.load_rom(rom);
+                    chip8.SetClockRate(hz);
+                    if(forceQuirks) {
+                        chip8.SetQuirks(quirks);
+                    }
+
+                    if(error != RomError::None)
+                    {
+                        std::cerr << rom << ": " << RomErrorString(error) << "\n";
+                        failures++;
+                        return;
+                    }
+                }
+
+                if(playback && playback->GetRomHash() != machines[0].GetRomHash())
+                {
+                    std::cerr << rom << ": movie was recorded with a different ROM\n";
+                    failures++;
+                }
+                else if(!run_batch(machines, cycles, playback, verify, stats[worker].vector_instructions))
+                {
+                    std::cerr << rom << ": batch does not match the reference interpreter\n";
+                    failures++;
+                }
+
+                auto jobEnd = std::chrono::steady_clock::now();
+
+                stats[worker].instructions += cycles * lanes;
+                stats[worker].jobs++;
+                stats[worker].seconds += std::chrono::duration<double>(jobEnd - jobStart).count();
+            });
+        }
+
+        for(unsigned int instance = 0; !batch && instance < instances; instance++)
+        {
+            //Each task only touches the stats slot of the worker running it
+            //Instances of one ROM get consecutive seeds unless a movie fixes it
+            uint64_t instanceSeed = playback ? seed : seed + instance;
+
+            //--wav records the first instance of the first ROM
+            char const* wav = rom == roms[0] && instance == 0 ? wavPath : nullptr;
+
+            pool.Submit([rom, instance, cycles, engine, hz, instanceSeed, playback, verify, useWatchdog, quirks, forceQuirks, wav,
+                         &stats, &failures](unsigned int worker) {
+                auto jobStart = std::chrono::steady_clock::now();
+
+                Chip8 chip8(instanceSeed);
+                RomError error = chip8.load_rom(rom);
+                chip8.SetEngine(engine);
+                chip8.SetClockRate(hz);
+
+                //An explicit profile overrides the database
+                if(forceQuirks) {
+                    chip8.SetQuirks(quirks);
+                }
+
+                if(error != RomError::None)
+                {
+                    std::cerr << rom << ": " << RomErrorString(error) << "\n";
+                    failures++;
+                    return;
+                }
+
+                if(playback && playback->GetRomHash() != chip8.GetRomHash())
+                {
+                    std::cerr << rom << ": movie was recorded with a different ROM\n";
+                    failures++;
+                }
+                else
+                {
+                    NullFrontend audio;
+                    Watchdog watchdog;
+                    if(!run_job(chip8, cycles, playback, wav ? &audio : nullptr, verify, useWatchdog ? &watchdog : nullptr))
+                    {
+                        std::cerr << rom << ": engine does not match the reference interpreter\n";
+                        failures++;
+                    }
+                    if(watchdog.GetTermination() != Termination::Running)
+                    {
+                        std::cout << describe_stop(rom, instance, chip8, watchdog);
+                        stats[worker].stopped++;
+                    }
+                    if(wav && !audio.WriteWav(wav))
+                    {
+                        std::cerr << "cannot write " << wav << "\n";
+                        failures++;
+                    }
+                }
+
+                auto jobEnd = std::chrono::steady_clock::now();
+
+                //Less than cycles when the watchdog stopped the run; cycles
+                //skipped in idle loops advanced the clock without running
+                stats[worker].instructions += chip8.GetCycleCount() - chip8.GetSkippedCycles();
+                stats[worker].skipped_cycles += chip8.GetSkippedCycles();
+                stats[worker].jobs++;
+                stats[worker].seconds += std::chrono::duration<double>(jobEnd - jobStart).count();
+            });
+        }
+    }
+
+    pool.Wait();
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t total = 0;
+    uint64_t vectorTotal = 0;
+    uint64_t skippedTotal = 0;
+    uint64_t stoppedTotal = 0;
+
+    for(std::size_t worker = 0; worker < stats.size(); worker++)
+    {
+        WorkerStats const& s = stats[worker];
+        double ips = s.seconds > 0 ? s.instructions / s.seconds : 0.0;
+        total += s.instructions;
+        vectorTotal += s.vector_instructions;
+        skippedTotal += s.skipped_cycles;
+        stoppedTotal += s.stopped;
+
+        std::cout << "worker " << worker << ": " << s.jobs << " jobs, "
+                  << s.instructions << " instructions, " << s.skipped_cycles << " cycles skipped, "
+                  << ips << " IPS\n";
+    }
+
+    //IPS counts only executed instructions, not the idle cycles skipped
+    std::cout << "aggregate: " << total << " instructions, " << skippedTotal << " cycles skipped in "
+              << wall << " s, " << (wall > 0 ? total / wall : 0.0) << " IPS\n";
+
+    uint64_t cyclesTotal = total + skippedTotal;
+    std::cout << "idle: " << skippedTotal << " cycles skipped in idle loops"
+              << " (" << (cyclesTotal > 0 ? 100.0 * skippedTotal / cyclesTotal : 0.0) << "% of cycles)\n";
+
+    if(useWatchdog) {
+        std::cout << "watchdog: " << stoppedTotal << " instances stopped early\n";
+    }
+
+    if(batch)
+    {
+        std::cout << "batch: " << vectorTotal << " instructions ran as vector operations"
+                  << " (" << (total > 0 ? 100.0 * vectorTotal / total : 0.0) << "%), vector path "
+                  << (Chip8Batch::HasVectorPath() ? "on" : "off") << "\n";
+    }
+
+    return failures == 0 ? 0 : EXIT_FAILURE;
+}
@@ -1,47 +1,331 @@
+#include "Beeper.h"
 #include "Chip8.h"
+#include "FrameScheduler.h"
+#include "Movie.h"
 #include "Platform.h"
+#include "Profiler.h"
+#include "Rewind.h"
+#include "TripleBuffer.h"
+#include <algorithm>
+#include <cctype>
+#include <atomic>
 #include <chrono>
+#include <fstream>
 #include <iostream>
+#include <string>
+#include <thread>
 
 
+static void usage(char const* program)
+{
+    std::cerr << "Usage: " << program
+              << " <Scale> <Clock Hz> <ROM> [--vsync] [--seed N] [--record FILE] [--play FILE]"
+              << " [--profile PREFIX] [--quirks vip|chip48|schip] [--quirks-db FILE]"
+              << " [--keys 16 characters for keys 0-F, default x123qweasdzc4rfv] [--run-ahead FRAMES]"
+              << " [--rewind MEGABYTES]\n";
+    std::exit(EXIT_FAILURE);
+}
+
 int main(int argc, char** argv)
 {
-    if (argc != 4)
+    if (argc < 4)
     {
-        std::cerr << "Usage: " << argv[0] << " <Scale> <Delay> <ROM>\n";
-        std::exit(EXIT_FAILURE);
+        usage(argv[0]);
     }
 
     int videoScale = std::stoi(argv[1]);
-    int cycleDelay = std::stoi(argv[2]);
+    int clockRate = std::stoi(argv[2]);
     char const* romFilename = argv[3];
 
-    Platform platform("CHIP-8 Emulator", VIDEO_WIDTH * videoScale, VIDEO_HEIGHT * videoScale, VIDEO_WIDTH, VIDEO_HEIGHT);
+    bool vsync = false;
+    uint64_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+    char const* recordPath = nullptr;
+    char const* playPath = nullptr;
+    char const* profilePrefix = nullptr;
+    QuirkProfile quirks = QuirkProfile::CosmacVip;
+    bool forceQuirks = false;
+    std::string keyBindings;
+    unsigned int runAhead = 0;
+    std::size_t rewindBudget = 0;
 
-    Chip8 chip8;
-    chip8.LoadROM(romFilename);
+    for (int i = 4; i < argc; i++)
+    {
+        std::string arg = argv[i];
 
-    int videoPitch = sizeof(chip8.video[0]) * VIDEO_WIDTH;
+        if (arg == "--vsync")
+        {
+            vsync = true;
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            seed = std::stoull(argv[++i]);
+        }
+        else if (arg == "--record" && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else if (arg == "--play" && i + 1 < argc)
+        {
+            playPath = argv[++i];
+        }
+        else if (arg == "--profile" && i + 1 < argc)
+        {
+            profilePrefix = argv[++i];
+        }
+        else if (arg == "--quirks" && i + 1 < argc)
+        {
+            if (!ParseQuirkProfile(argv[++i], quirks))
+            {
+                usage(argv[0]);
+            }
+            forceQuirks = true;
+        }
+        else if (arg == "--keys" && i + 1 < argc && std::string(argv[i + 1]).size() == KEY_COUNT)
+        {
+            keyBindings = argv[++i];
+        }
+        else if (arg == "--run-ahead" && i + 1 < argc)
+        {
+            runAhead = std::stoul(argv[++i]);
+        }
+        else if (arg == "--rewind" && i + 1 < argc)
+        {
+            rewindBudget = std::stoull(argv[++i]) * 1024 * 1024;
+        }
+        else if (arg == "--quirks-db" && i + 1 < argc)
+        {
+            if (!QuirkDatabase::Global().Load(argv[++i]))
+            {
+                std::cerr << "Cannot read quirk database " << argv[i] << "\n";
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+
+    //Playback takes the seed and clock rate from the recording
+    Movie movie;
+    if (playPath)
+    {
+        if (!movie.Load(playPath))
+        {
+            std::cerr << "Cannot read movie " << playPath << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+        seed = movie.GetSeed();
+        clockRate = movie.GetClockRate();
+    }
+
+    Platform platform("CHIP-8 Emulator", VIDEO_WIDTH * videoScale, VIDEO_HEIGHT * videoScale, VIDEO_WIDTH, VIDEO_HEIGHT, vsync);
+    for (std::size_t key = 0; key < keyBindings.size(); key++)
+    {
+        platform.BindKey(key, std::tolower(static_cast<unsigned char>(keyBindings[key])));
+    }
+    Frontend& frontend = platform;
 
-    auto lastCycleTime = std::chrono::high_resolution_clock::now();
-    bool quit = false;
+    Chip8 chip8(seed);
+    RomError error = chip8.load_rom(romFilename);
+    if (error != RomError::None)
+    {
+        std::cerr << romFilename << ": " << RomErrorString(error) << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+    chip8.SetClockRate(clockRate);
 
-    while (!quit)
+    //An explicit profile overrides the database
+    if (forceQuirks)
     {
-        quit = platform.ProcessInput(chip8.keypad);
+        chip8.SetQuirks(quirks);
+    }
+
+    if (playPath && movie.GetRomHash() != chip8.GetRomHash())
+    {
+        std::cerr << "Movie was recorded with a different ROM\n";
+        std::exit(EXIT_FAILURE);
+    }
+    if (recordPath)
+    {
+        movie = Movie(seed, chip8.GetRomHash(), clockRate);
+    }
 
-        auto currentTime = std::chrono::high_resolution_clock::now();
-        float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - lastCycleTime).count();
+    std::cout << "seed " << seed << ", quirks " << QuirkProfileName(chip8.GetQuirks()) << "\n";
 
-        if (dt > cycleDelay)
+    //A completed frame as the emulation thread publishes it
+    struct Frame
+    {
+        uint64_t rows[VIDEO_HEIGHT];
+    };
+
+    TripleBuffer<Frame> frames;
+    std::atomic<uint16_t> heldKeys {0};
+    std::atomic<bool> rewindHeld {false};
+    std::atomic<bool> quit {false};
+
+    //Profiling switches the core to the instrumented reference path
+    InstructionProfiler profiler;
+
+    //One emulated frame per timer tick, paced on its own thread so a present
+    //blocked on vsync never slows the emulated rate
+    FrameScheduler emulationScheduler(TIMER_RATE, false);
+
+    //Run-ahead shows the frame that the current input produces runAhead
+    //frames from now, then rolls back, hiding the ROM's own input lag
+    static Chip8::Snapshot snapshot;
+
+    //Holding Backspace steps back one recorded frame per frame. A movie has
+    //to stay a straight line of input, so recording and playback turn it off
+    RewindBuffer rewind(playPath || recordPath ? 0 : rewindBudget);
+
+    //Audio is rendered on the emulation thread from the beeper edges of each
+    //real frame; frames run ahead and then rolled back are never heard
+    BeeperSynth synth;
+    float samples[SAMPLES_PER_FRAME];
+
+    std::thread emulation([&]()
+    {
+        std::size_t frame = 0;
+
+        while (!quit.load(std::memory_order_relaxed))
+        {
+            if (rewindHeld.load(std::memory_order_relaxed) && !rewind.Empty()
+                && rewind.NewestFrame() > rewind.OldestFrame())
+            {
+                rewind.Seek(rewind.NewestFrame() - 1, chip8);
+                synth.Reset(chip8.GetCycleCount(), chip8.IsSoundOn());
+
+                Frame& out = frames.Back();
+                std::copy(std::begin(chip8.screen), std::end(chip8.screen), std::begin(out.rows));
+                frames.Publish();
+
+                emulationScheduler.WaitForNextFrame();
+                continue;
+            }
+
+            uint16_t held = heldKeys.load(std::memory_order_relaxed);
+
+            if (playPath && !movie.Apply(frame, held))
+            {
+                quit = true;
+                break;
+            }
+            if (recordPath)
+            {
+                movie.Record(held);
+            }
+            chip8.SetKeys(held);
+
+            if (profilePrefix)
+            {
+                chip8.RunUntilFrame(profiler);
+            }
+            else
+            {
+                chip8.RunUntilFrame();
+            }
+            frame++;
+            rewind.Push(chip8);
+
+            synth.Render(chip8, samples, SAMPLES_PER_FRAME);
+            frontend.QueueAudio(samples, SAMPLES_PER_FRAME);
+
+            Frame& out = frames.Back();
+
+            if (runAhead > 0)
+            {
+                chip8.Capture(snapshot);
+                for (unsigned int ahead = 0; ahead < runAhead; ahead++)
+                {
+                    chip8.RunUntilFrame();
+                }
+            }
+
+            std::copy(std::begin(chip8.screen), std::end(chip8.screen), std::begin(out.rows));
+            frames.Publish();
+
+            if (runAhead > 0)
+            {
+                chip8.Restore(snapshot);
+            }
+
+            emulationScheduler.WaitForNextFrame();
+        }
+    });
+
+    //The render thread only ever sees published frames, and finds the rows
+    //to upload by comparing against the last frame it showed
+    uint16_t keys = 0;
+    uint64_t shown[VIDEO_HEIGHT] {};
+    uint32_t pixels[VIDEO_WIDTH * VIDEO_HEIGHT] {};
+    int videoPitch = sizeof(pixels[0]) * VIDEO_WIDTH;
+    uint32_t dirtyRows = 0xFFFFFFFFu;
+
+    FrameScheduler renderScheduler(TIMER_RATE, vsync);
+
+    while (!quit.load(std::memory_order_relaxed))
+    {
+        if (frontend.ProcessInput(keys))
+        {
+            quit = true;
+        }
+        heldKeys.store(keys, std::memory_order_relaxed);
+        rewindHeld.store(platform.IsRewindHeld(), std::memory_order_relaxed);
+
+        if (frames.Acquire())
+        {
+            Frame const& latest = frames.Front();
+            for (unsigned int row = 0; row < VIDEO_HEIGHT; row++)
+            {
+                if (latest.rows[row] != shown[row])
+                {
+                    shown[row] = latest.rows[row];
+                    dirtyRows |= 1u << row;
+                }
+            }
+        }
+
+        auto updateStart = std::chrono::steady_clock::now();
+        Chip8::ExpandScreen(shown, dirtyRows, pixels);
+        frontend.Update(pixels, videoPitch, dirtyRows);
+        dirtyRows = 0;
+        if (profilePrefix)
         {
-            lastCycleTime = currentTime;
+            profiler.OnHostUpdate(std::chrono::steady_clock::now() - updateStart);
+        }
+
+        renderScheduler.WaitForNextFrame();
+    }
 
-            chip8.Cycle();
+    emulation.join();
+
+    std::cout << "emulation thread\n";
+    emulationScheduler.Report(std::cout);
+    std::cout << "render thread\n";
+    renderScheduler.Report(std::cout);
+
+    if (profilePrefix)
+    {
+        std::string prefix = profilePrefix;
+        std::ofstream flat(prefix + ".profile.txt");
+        std::ofstream heatmap(prefix + ".heatmap.csv");
 
-            platform.Update(chip8.video, videoPitch);
+        profiler.WriteFlatProfile(flat);
+        profiler.WriteHeatmap(heatmap);
+
+        if (!flat || !heatmap)
+        {
+            std::cerr << "Cannot write profile " << prefix << "\n";
+            return EXIT_FAILURE;
         }
     }
 
+    if (recordPath && !movie.Save(recordPath))
+    {
+        std::cerr << "Cannot write movie " << recordPath << "\n";
+        return EXIT_FAILURE;
+    }
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,702 @@
+#include "Chip8.h"
+#include "Profiler.h"
+#include "Quirks.h"
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+Translates a ROM into a C++ file that defines a CompiledRom (Compiled.h).
+
+Code is found by recursive descent from START_ADD, following jumps, calls,
+return sites and both sides of every skip. Each instruction found becomes a
+labelled region of one function, with V0-VF and I held in locals, so a
+basic block is straight-line code that falls through to the next one or
+ends in a goto. Every region checks the instruction budget first, which
+lets RunFor stop on the exact cycle of a timer tick and enter again at any
+instruction.
+
+Left to the interpreter: Bnnn, whose target is only known at run time;
+Fx0A and Fx18, which have to yield to RunFor; invalid opcodes; 00EE and
+2nnn when they would fault; and all code once a store changes a
+translated byte. Generated code returns to the engine at those points,
+and the engine re-enters it as soon as the pc is back on translated code.
+*/
+
+//How control leaves an instruction
+enum class Flow {
+    Next,        //Falls through to the next instruction
+    Jump,        //1nnn
+    Call,        //2nnn
+    Return,      //00EE
+    Skip,        //Next instruction or the one after
+    Interpreted  //Runs on the interpreter instead
+};
+
+//Every instruction the translator tells apart, decoded from the opcode
+//nibbles the way Chip8::resolve picks a handler
+enum class Op {
+    Op00E0, Op00EE, Op1nnn, Op2nnn, Op3xkk, Op4xkk, Op5xy0, Op6xkk, Op7xkk,
+    Op8xy0, Op8xy1, Op8xy2, Op8xy3, Op8xy4, Op8xy5, Op8xy6, Op8xy7, Op8xyE,
+    Op9xy0, OpAnnn, OpBnnn, OpCxkk, OpDxyn, OpEx9E, OpExA1,
+    OpFx07, OpFx0A, OpFx15, OpFx18, OpFx1E, OpFx29, OpFx33, OpFx55, OpFx65,
+    OpNULL   //No handler
+};
+
+static Op op_of(uint16_t opcode)
+{
+    unsigned int n = opcode & 0x000Fu;
+
+    switch(opcode >> 12u)
+    {
+        case 0x0: return n == 0x0 ? Op::Op00E0 : n == 0xE ? Op::Op00EE : Op::OpNULL;
+        case 0x1: return Op::Op1nnn;
+        case 0x2: return Op::Op2nnn;
+        case 0x3: return Op::Op3xkk;
+        case 0x4: return Op::Op4xkk;
+        case 0x5: return Op::Op5xy0;
+        case 0x6: return Op::Op6xkk;
+        case 0x7: return Op::Op7xkk;
+        case 0x8:
+            switch(n)
+            {
+                case 0x0: return Op::Op8xy0;
+                case 0x1: return Op::Op8xy1;
+                case 0x2: return Op::Op8xy2;
+                case 0x3: return Op::Op8xy3;
+                case 0x4: return Op::Op8xy4;
+                case 0x5: return Op::Op8xy5;
+                case 0x6: return Op::Op8xy6;
+                case 0x7: return Op::Op8xy7;
+                case 0xE: return Op::Op8xyE;
+                default: return Op::OpNULL;
+            }
+        case 0x9: return Op::Op9xy0;
+        case 0xA: return Op::OpAnnn;
+        case 0xB: return Op::OpBnnn;
+        case 0xC: return Op::OpCxkk;
+        case 0xD: return Op::OpDxyn;
+        case 0xE: return n == 0xE ? Op::OpEx9E : n == 0x1 ? Op::OpExA1 : Op::OpNULL;
+        default:
+            switch(opcode & 0x00FFu)
+            {
+                case 0x07: return Op::OpFx07;
+                case 0x0A: return Op::OpFx0A;
+                case 0x15: return Op::OpFx15;
+                case 0x18: return Op::OpFx18;
+                case 0x1E: return Op::OpFx1E;
+                case 0x29: return Op::OpFx29;
+                case 0x33: return Op::OpFx33;
+                case 0x55: return Op::OpFx55;
+                case 0x65: return Op::OpFx65;
+                default: return Op::OpNULL;
+            }
+    }
+}
+
+//Quirks that change inlined code; the rest run through interpreter handlers
+struct Policy {
+    bool shiftFromVy;
+    bool logicResetsVf;
+};
+
+template<typename Quirks>
+static Policy make_policy()
+{
+    return Policy {Quirks::SHIFT_FROM_VY, Quirks::LOGIC_RESETS_VF};
+}
+
+static Policy policy_for(QuirkProfile profile)
+{
+    switch(profile)
+    {
+        case QuirkProfile::Chip48: return make_policy<Chip48Quirks>();
+        case QuirkProfile::SuperChip: return make_policy<SuperChipQuirks>();
+        default: return make_policy<CosmacVipQuirks>();
+    }
+}
+
+//The last address an instruction can start at without the pc leaving memory
+static const unsigned int LAST_ADDRESS = MEMORY_SIZE - 4;
+
+class Recompiler {
+    public:
+        Recompiler(uint8_t const* memory, Policy policy) : memory(memory), policy(policy) {}
+
+        void Discover();
+
+        void Emit(std::ostream& out, uint64_t romHash, QuirkProfile quirks, bool wrap,
+                  std::string const& source) const;
+
+        unsigned int Instructions() const;
+
+        unsigned int Blocks() const;
+
+        unsigned int Interpreted() const;
+
+    private:
+        uint8_t const* memory;
+        Policy policy;
+
+        //Per address: an instruction was translated there, one was left to
+        //the interpreter, or control can arrive there other than by falling
+        //through
+        std::vector<uint8_t> translated = std::vector<uint8_t>(MEMORY_SIZE);
+        std::vector<uint8_t> interpreted = std::vector<uint8_t>(MEMORY_SIZE);
+        std::vector<uint8_t> leader = std::vector<uint8_t>(MEMORY_SIZE);
+
+        uint16_t opcode_at(unsigned int address) const
+        {
+            return static_cast<uint16_t>((memory[address] << 8u) | memory[address + 1]);
+        }
+
+        //Profiler label, only for comments in the output
+        static std::string name_of(uint16_t opcode)
+        {
+            return InstructionProfiler::ClassName(InstructionProfiler::OpcodeClass(opcode));
+        }
+
+        static Flow flow_of(uint16_t opcode);
+
+        //The 1nnn at address jumps to itself or back to an Fx07 / 3xkk or
+        //4xkk delay timer poll, the loops Chip8::RunFor skips
+        bool closes_idle_loop(unsigned int address) const;
+
+        std::string target(unsigned int address) const;
+
+        void emit_instruction(std::ostream& out, unsigned int address) const;
+};
+
+Flow Recompiler::flow_of(uint16_t opcode)
+{
+    switch(op_of(opcode))
+    {
+        case Op::Op1nnn:
+            return Flow::Jump;
+        case Op::Op2nnn:
+            return Flow::Call;
+        case Op::Op00EE:
+            return Flow::Return;
+        case Op::Op3xkk:
+        case Op::Op4xkk:
+        case Op::Op5xy0:
+        case Op::Op9xy0:
+        case Op::OpEx9E:
+        case Op::OpExA1:
+            return Flow::Skip;
+        case Op::OpBnnn:
+        case Op::OpFx0A:
+        case Op::OpFx18:
+        case Op::OpNULL:
+            return Flow::Interpreted;
+        default:
+            return Flow::Next;
+    }
+}
+
+bool Recompiler::closes_idle_loop(unsigned int address) const
+{
+    unsigned int top = opcode_at(address) & 0x0FFFu;
+    if(top == address) {
+        return true;
+    }
+    if(top + 4 != address) {
+        return false;
+    }
+
+    uint16_t load = opcode_at(top);
+    uint16_t test = opcode_at(top + 2);
+    return op_of(load) == Op::OpFx07 && (op_of(test) == Op::Op3xkk || op_of(test) == Op::Op4xkk)
+           && ((load >> 8u) & 0xFu) == ((test >> 8u) & 0xFu);
+}
+
+void Recompiler::Discover()
+{
+    std::vector<unsigned int> pending {START_ADD};
+    leader[START_ADD] = 1;
+
+    auto follow = [this, &pending](unsigned int address) {
+        if(address < MEMORY_SIZE) {
+            leader[address] = 1;
+            pending.push_back(address);
+        }
+    };
+
+    while(!pending.empty())
+    {
+        unsigned int address = pending.back();
+        pending.pop_back();
+
+        //Walk straight-line code until control leaves it or joins code
+        //that was already walked
+        while(!translated[address] && !interpreted[address])
+        {
+            if(address > LAST_ADDRESS)
+            {
+                interpreted[address] = 1;
+                break;
+            }
+
+            uint16_t opcode = opcode_at(address);
+            Flow flow = flow_of(opcode);
+
+            //OP_1nnn yields on a jump back into an idle loop so RunFor can
+            //skip the loop, which translated code would not
+            if(flow == Flow::Jump && closes_idle_loop(address))
+            {
+                interpreted[address] = 1;
+                follow(opcode & 0x0FFFu);
+                break;
+            }
+
+            if(flow == Flow::Interpreted)
+            {
+                //Everything but Bnnn carries on at the next instruction
+                interpreted[address] = 1;
+                if(op_of(opcode) != Op::OpBnnn) {
+                    follow(address + 2);
+                }
+                break;
+            }
+
+            translated[address] = 1;
+
+            if(flow == Flow::Next) {
+                address += 2;
+                continue;
+            }
+
+            if(flow == Flow::Jump) {
+                follow(opcode & 0x0FFFu);
+            }
+            else if(flow == Flow::Call) {
+                follow(opcode & 0x0FFFu);
+                follow(address + 2);
+            }
+            else if(flow == Flow::Skip) {
+                follow(address + 2);
+                follow(address + 4);
+            }
+            break;
+        }
+
+        //Joining existing code starts a block there
+        if(address < MEMORY_SIZE) {
+            leader[address] = 1;
+        }
+    }
+}
+
+unsigned int Recompiler::Instructions() const
+{
+    unsigned int count = 0;
+    for(unsigned int address = 0; address < MEMORY_SIZE; address++) {
+        count += translated[address];
+    }
+    return count;
+}
+
+unsigned int Recompiler::Blocks() const
+{
+    unsigned int count = 0;
+    for(unsigned int address = 0; address < MEMORY_SIZE; address++)
+    {
+        if(!translated[address]) {
+            continue;
+        }
+        bool fallsIn = address >= 2 && translated[address - 2]
+                       && flow_of(opcode_at(address - 2)) == Flow::Next;
+        count += leader[address] || !fallsIn;
+    }
+    return count;
+}
+
+unsigned int Recompiler::Interpreted() const
+{
+    unsigned int count = 0;
+    for(unsigned int address = 0; address < MEMORY_SIZE; address++) {
+        count += interpreted[address];
+    }
+    return count;
+}
+
+static std::string hex(unsigned int value, int digits)
+{
+    std::ostringstream text;
+    text << std::uppercase << std::hex << std::setw(digits) << std::setfill('0') << value;
+    return text.str();
+}
+
+static std::string label(unsigned int address)
+{
+    return "a_" + hex(address, 3);
+}
+
+static std::string reg(unsigned int index)
+{
+    return "V" + hex(index, 1);
+}
+
+//Continues at address: translated code directly, anything else through the engine
+std::string Recompiler::target(unsigned int address) const
+{
+    if(address < MEMORY_SIZE && translated[address]) {
+        return "goto " + label(address) + ";";
+    }
+    return "{ pc = 0x" + hex(address, 3) + "; goto leave; }";
+}
+
+void Recompiler::emit_instruction(std::ostream& out, unsigned int address) const
+{
+    uint16_t opcode = opcode_at(address);
+    Op op = op_of(opcode);
+
+    std::string Vx = reg((opcode >> 8u) & 0xFu);
+    std::string Vy = reg((opcode >> 4u) & 0xFu);
+    std::string kk = "0x" + hex(opcode & 0xFFu, 2);
+    unsigned int nnn = opcode & 0x0FFFu;
+    bool same = ((opcode >> 8u) & 0xFu) == ((opcode >> 4u) & 0xFu);
+    std::string here = "0x" + hex(address, 3);
+    std::string next = target(address + 2);
+    std::string skip = target(address + 4);
+
+    //Opcodes that run through the interpreter's handler, with only the
+    //registers the handler reads written back and the ones it writes reloaded
+    unsigned int x = (opcode >> 8u) & 0xFu;
+    std::string save;
+    std::string load;
+    if(op == Op::OpDxyn) {
+        save = " R[" + std::to_string(x) + "] = " + Vx + "; R[" + std::to_string((opcode >> 4u) & 0xFu) + "] = " + Vy + ";";
+        load = " VF = R[15];";
+    }
+    else if(op == Op::OpFx29 || op == Op::OpFx33) {
+        save = " R[" + std::to_string(x) + "] = " + Vx + ";";
+    }
+    else if(op == Op::OpFx55) {
+        for(unsigned int i = 0; i <= x; i++) {
+            save += " R[" + std::to_string(i) + "] = " + reg(i) + ";";
+        }
+    }
+    else if(op == Op::OpFx65) {
+        for(unsigned int i = 0; i <= x; i++) {
+            load += " " + reg(i) + " = R[" + std::to_string(i) + "];";
+        }
+    }
+    std::string execute = "CompiledRuntime::Index(chip8) = I;" + save
+                          + " CompiledRuntime::Execute(chip8, 0x" + hex(opcode, 4) + ");" + load
+                          + " I = CompiledRuntime::Index(chip8);";
+
+    //Puts the instruction back for the interpreter, which will fault on it
+    std::string give_back = "{ left++; pc = " + here + "; goto leave; }";
+
+    out << label(address) << ": //" << hex(opcode, 4) << " " << name_of(opcode) << "\n";
+    out << "    if(left == 0) { pc = " << here << "; goto leave; }\n";
+    out << "    left--;\n";
+
+    if(op == Op::Op00EE) {
+        out << "    if(CompiledRuntime::StackPointer(chip8) == 0) " << give_back << "\n";
+        out << "    pc = CompiledRuntime::Stack(chip8)[--CompiledRuntime::StackPointer(chip8)];\n";
+        out << "    goto dispatch;\n";
+    }
+    else if(op == Op::Op1nnn) {
+        out << "    " << target(nnn) << "\n";
+    }
+    else if(op == Op::Op2nnn) {
+        out << "    if(CompiledRuntime::StackPointer(chip8) >= 16) " << give_back << "\n";
+        out << "    CompiledRuntime::Stack(chip8)[CompiledRuntime::StackPointer(chip8)++] = 0x"
+            << hex(address + 2, 3) << ";\n";
+        out << "    " << target(nnn) << "\n";
+    }
+    else if(op == Op::Op3xkk) {
+        out << "    if(" << Vx << " == " << kk << ") " << skip << "\n    " << next << "\n";
+    }
+    else if(op == Op::Op4xkk) {
+        out << "    if(" << Vx << " != " << kk << ") " << skip << "\n    " << next << "\n";
+    }
+    else if(op == Op::Op5xy0) {
+        //A register always equals itself, so x == y always skips
+        if(same) {
+            out << "    " << skip << "\n";
+        }
+        else {
+            out << "    if(" << Vx << " == " << Vy << ") " << skip << "\n    " << next << "\n";
+        }
+    }
+    else if(op == Op::Op9xy0) {
+        if(same) {
+            out << "    " << next << "\n";
+        }
+        else {
+            out << "    if(" << Vx << " != " << Vy << ") " << skip << "\n    " << next << "\n";
+        }
+    }
+    else if(op == Op::OpEx9E) {
+        out << "    if(CompiledRuntime::Keys(chip8) & (1u << (" << Vx << " & 0xFu))) " << skip << "\n    " << next << "\n";
+    }
+    else if(op == Op::OpExA1) {
+        out << "    if(!(CompiledRuntime::Keys(chip8) & (1u << (" << Vx << " & 0xFu)))) " << skip << "\n    " << next << "\n";
+    }
+    else
+    {
+        //Straight-line instructions; flags are written after the result, as
+        //the handlers do, so x = F behaves the same
+        std::string Vs = policy.shiftFromVy ? Vy : Vx;
+        std::string resetVf = policy.logicResetsVf ? " VF = 0;" : "";
+
+        if(op == Op::Op00E0) {
+            out << "    CompiledRuntime::Execute(chip8, 0x" << hex(opcode, 4) << ");\n";
+        }
+        else if(op == Op::Op6xkk) {
+            out << "    " << Vx << " = " << kk << ";\n";
+        }
+        else if(op == Op::Op7xkk) {
+            out << "    " << Vx << " = uint8_t(" << Vx << " + " << kk << ");\n";
+        }
+        else if(op == Op::Op8xy0) {
+            if(!same) {
+                out << "    " << Vx << " = " << Vy << ";\n";
+            }
+        }
+        else if(op == Op::Op8xy1) {
+            out << "    " << Vx << " |= " << Vy << ";" << resetVf << "\n";
+        }
+        else if(op == Op::Op8xy2) {
+            out << "    " << Vx << " &= " << Vy << ";" << resetVf << "\n";
+        }
+        else if(op == Op::Op8xy3) {
+            out << "    " << Vx << " ^= " << Vy << ";" << resetVf << "\n";
+        }
+        else if(op == Op::Op8xy4) {
+            out << "    { unsigned sum = " << Vx << " + " << Vy << "; " << Vx << " = uint8_t(sum); VF = sum > 0xFFu; }\n";
+        }
+        else if((op == Op::Op8xy5 || op == Op::Op8xy7) && same) {
+            //Subtracting a register from itself never borrows
+            out << "    " << Vx << " = 0; VF = 1;\n";
+        }
+        else if(op == Op::Op8xy5) {
+            out << "    { uint8_t flag = " << Vx << " >= " << Vy << "; " << Vx << " = uint8_t(" << Vx << " - " << Vy << "); VF = flag; }\n";
+        }
+        else if(op == Op::Op8xy6) {
+            out << "    { uint8_t flag = " << Vs << " & 1u; " << Vx << " = " << Vs << " >> 1u; VF = flag; }\n";
+        }
+        else if(op == Op::Op8xy7) {
+            out << "    { uint8_t flag = " << Vy << " >= " << Vx << "; " << Vx << " = uint8_t(" << Vy << " - " << Vx << "); VF = flag; }\n";
+        }
+        else if(op == Op::Op8xyE) {
+            out << "    { uint8_t flag = " << Vs << " >> 7u; " << Vx << " = uint8_t(" << Vs << " << 1u); VF = flag; }\n";
+        }
+        else if(op == Op::OpAnnn) {
+            out << "    I = 0x" << hex(nnn, 3) << ";\n";
+        }
+        else if(op == Op::OpCxkk) {
+            out << "    " << Vx << " = CompiledRuntime::Random(chip8) & " << kk << ";\n";
+        }
+        else if(op == Op::OpFx07) {
+            out << "    " << Vx << " = CompiledRuntime::DelayTimer(chip8);\n";
+        }
+        else if(op == Op::OpFx15) {
+            out << "    CompiledRuntime::DelayTimer(chip8) = " << Vx << ";\n";
+        }
+        else if(op == Op::OpFx1E) {
+            out << "    I = uint16_t(I + " << Vx << ");\n";
+        }
+        else if(op == Op::OpFx33 || op == Op::OpFx55) {
+            //A store into translated code ends translated execution
+            out << "    " << execute << "\n";
+            out << "    if(CompiledRuntime::Stale(chip8)) { pc = 0x" << hex(address + 2, 3) << "; goto leave; }\n";
+        }
+        else {
+            //Dxyn, Fx29 and Fx65
+            out << "    " << execute << "\n";
+        }
+
+        //Fall through when the next instruction is emitted right after;
+        //code read at odd offsets can put another one in between
+        if(!translated[address + 2] || translated[address + 1]) {
+            out << "    " << next << "\n";
+        }
+    }
+}
+
+void Recompiler::Emit(std::ostream& out, uint64_t romHash, QuirkProfile quirks, bool wrap,
+                      std::string const& source) const
+{
+    out << "//Generated by recompile from " << source << " for the " << QuirkProfileName(quirks)
+        << " profile" << (wrap ? " with sprite wrapping" : "") << "; do not edit\n";
+    out << "#include \"Compiled.h\"\n\n";
+    out << "namespace {\n\n";
+
+    out << "const uint8_t IMAGE[MEMORY_SIZE] = {";
+    for(unsigned int address = 0; address < MEMORY_SIZE; address++) {
+        out << (address % 16 == 0 ? "\n    " : " ") << "0x" << hex(memory[address], 2) << ",";
+    }
+    out << "\n};\n\n";
+
+    out << "const uint8_t CODE_MAP[MEMORY_SIZE] = {";
+    for(unsigned int address = 0; address < MEMORY_SIZE; address++)
+    {
+        bool code = translated[address] || (address > 0 && translated[address - 1]);
+        out << (address % 32 == 0 ? "\n    " : " ") << (code ? 1 : 0) << ",";
+    }
+    out << "\n};\n\n";
+
+    out << "#define LOAD_REGISTERS()";
+    for(unsigned int i = 0; i < 16; i++) {
+        out << " " << reg(i) << " = R[" << i << "];";
+    }
+    out << " I = CompiledRuntime::Index(chip8)\n";
+    out << "#define SAVE_REGISTERS()";
+    for(unsigned int i = 0; i < 16; i++) {
+        out << " R[" << i << "] = " << reg(i) << ";";
+    }
+    out << " CompiledRuntime::Index(chip8) = I\n\n";
+
+    out << "uint64_t run(Chip8& chip8, uint64_t budget)\n{\n";
+    out << "    uint8_t* R = CompiledRuntime::Registers(chip8);\n";
+    out << "    uint8_t";
+    for(unsigned int i = 0; i < 16; i++) {
+        out << (i ? ", " : " ") << reg(i);
+    }
+    out << ";\n    uint16_t I;\n";
+    out << "    LOAD_REGISTERS();\n\n";
+    out << "    uint16_t pc = CompiledRuntime::ProgramCounter(chip8);\n";
+    out << "    uint64_t left = budget;\n\n";
+
+    //Only 00EE jumps back to the dispatch after entry
+    bool returns = false;
+    for(unsigned int address = 0; address < MEMORY_SIZE; address++)
+    {
+        if(translated[address] && op_of(opcode_at(address)) == Op::Op00EE) {
+            returns = true;
+        }
+    }
+    if(returns) {
+        out << "dispatch:\n";
+    }
+    out << "    switch(pc)\n    {\n";
+    for(unsigned int address = 0; address < MEMORY_SIZE; address++)
+    {
+        if(translated[address]) {
+            out << "        case 0x" << hex(address, 3) << ": goto " << label(address) << ";\n";
+        }
+    }
+    out << "        default: goto leave;\n    }\n";
+
+    for(unsigned int address = 0; address < MEMORY_SIZE; address++)
+    {
+        if(!translated[address]) {
+            continue;
+        }
+        bool fallsIn = address >= 2 && translated[address - 2]
+                       && flow_of(opcode_at(address - 2)) == Flow::Next;
+        if(leader[address] || !fallsIn) {
+            out << "\n    //Block 0x" << hex(address, 3) << "\n";
+        }
+        emit_instruction(out, address);
+    }
+
+    out << "\nleave:\n";
+    out << "    SAVE_REGISTERS();\n";
+    out << "    CompiledRuntime::ProgramCounter(chip8) = pc;\n";
+    out << "    return budget - left;\n}\n\n";
+
+    out << "const CompiledRom ROM = {0x" << hex(static_cast<unsigned int>(romHash >> 32), 8)
+        << hex(static_cast<unsigned int>(romHash), 8) << "ull, QuirkProfile::";
+    switch(quirks)
+    {
+        case QuirkProfile::CosmacVip: out << "CosmacVip"; break;
+        case QuirkProfile::Chip48: out << "Chip48"; break;
+        case QuirkProfile::SuperChip: out << "SuperChip"; break;
+    }
+    out << ", " << (wrap ? "true" : "false") << ", IMAGE, CODE_MAP, run};\n\n";
+    out << "const bool REGISTERED = CompiledRomRegistry::Global().Add(&ROM);\n\n";
+    out << "}\n";
+}
+
+static void usage(char const* program)
+{
+    std::cerr << "Usage: " << program
+              << " [--quirks vip|chip48|schip] [--quirks-db FILE] [--wrap] <ROM> <Output.cpp>\n";
+    std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+    QuirkProfile quirks = QuirkProfile::CosmacVip;
+    bool forceQuirks = false;
+    bool wrap = false;
+    std::vector<char const*> positional;
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if(arg == "--quirks" && i + 1 < argc)
+        {
+            if(!ParseQuirkProfile(argv[++i], quirks))
+            {
+                usage(argv[0]);
+            }
+            forceQuirks = true;
+        }
+        else if(arg == "--quirks-db" && i + 1 < argc)
+        {
+            if(!QuirkDatabase::Global().Load(argv[++i]))
+            {
+                std::cerr << "cannot read quirk database " << argv[i] << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+        else if(arg == "--wrap")
+        {
+            wrap = true;
+        }
+        else
+        {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if(positional.size() != 2)
+    {
+        usage(argv[0]);
+    }
+
+    //Loading through Chip8 gives exactly the memory image the engine will see
+    Chip8 chip8;
+    RomError error = chip8.load_rom(positional[0]);
+    if(error != RomError::None)
+    {
+        std::cerr << positional[0] << ": " << RomErrorString(error) << "\n";
+        return EXIT_FAILURE;
+    }
+    if(forceQuirks)
+    {
+        chip8.SetQuirks(quirks);
+    }
+
+    static Chip8::Snapshot snapshot;
+    chip8.Capture(snapshot);
+
+    Recompiler recompiler(snapshot.memory, policy_for(chip8.GetQuirks()));
+    recompiler.Discover();
+
+    std::ofstream out(positional[1]);
+    recompiler.Emit(out, chip8.GetRomHash(), chip8.GetQuirks(), wrap, positional[0]);
+    if(!out)
+    {
+        std::cerr << "cannot write " << positional[1] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cerr << positional[0] << ": " << recompiler.Instructions() << " instructions in "
+              << recompiler.Blocks() << " blocks, " << recompiler.Interpreted()
+              << " left to the interpreter\n";
+
+    return 0;
+}